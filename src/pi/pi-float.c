@@ -1,29 +1,109 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef THREADS
+#ifndef CUSTOM_RANDOM
+#error "-DTHREADS needs -DCUSTOM_RANDOM, to jump ahead in random.c"
+#endif
+#include <string.h>
+#include <pthread.h>
+#endif
+
 #ifdef CUSTOM_RANDOM
 #include "random.c"
+#define RANDOM(s) random_next(s)
+#else
+// libc random() keeps its own state
+#define RANDOM(s) random()
+#define random_state 0
 #endif
 
-int main(int argc, char *argv[])
+// one block of samples, drawing from *state
+struct block {
+   unsigned long state;
+   unsigned int its, hits;
+};
+
+static void *count_hits(void *arg)
 {
-   unsigned int i, its, hits = 0;
+   struct block *b = arg;
+   unsigned int i, hits = 0;
    double d1, d2;
 
+   for (i = 0; i < b->its; i++) {
+      d1 = ((double)RANDOM(&b->state))/2147483647.0;
+      d2 = ((double)RANDOM(&b->state))/2147483647.0;
+      if (((d1*d1) + (d2*d2)) <= 1)
+	 hits++;
+   }
+   b->hits = hits;
+   return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned int its, hits = 0;
+   struct block one;
+
+#ifdef THREADS
+   int t, threads = 1;
+
+   if (argc == 4 && strcmp(argv[1], "-t") == 0) {
+      threads = atoi(argv[2]);
+      argv[2] = argv[0];
+      argc -= 2;
+      argv += 2;
+   }
+   if (argc != 2 || threads < 1) {
+      fprintf(stderr, "Usage: %s [-t threads] <iterations>\n", argv[0]);
+      return 1;
+   }
+#else
    if (argc != 2) {
       fprintf(stderr, "Usage: %s <iterations>\n", argv[0]);
       return 1;
    }
+#endif
 
    its = atoi(argv[1]);
    srandom(1);
-   for (i = 0; i < its; i++) {
-      d1 = ((double)random())/2147483647.0;
-      d2 = ((double)random())/2147483647.0;
-      if (((d1*d1) + (d2*d2)) <= 1)
-	 hits++;
+#ifdef THREADS
+   // Sample i takes draws 2i and 2i+1 of the one sequence whatever the
+   // number of threads, so the estimate does not depend on it.
+   if (threads > 1) {
+      struct block *b = malloc(threads * sizeof(*b));
+      pthread_t *tid = malloc(threads * sizeof(*tid));
+      unsigned int start = 0, end;
+
+      if (!b || !tid) {
+	 fprintf(stderr, "Out of memory.\n");
+	 return 1;
+      }
+      for (t = 0; t < threads; t++, start = end) {
+	 end = (unsigned int)((unsigned long long)its * (t + 1) / threads);
+	 b[t].state = random_state;
+	 random_jump(&b[t].state, 2 * (uint64_t)start);
+	 b[t].its = end - start;
+	 if (pthread_create(&tid[t], NULL, count_hits, &b[t])) {
+	    fprintf(stderr, "Cannot create thread.\n");
+	    return 1;
+	 }
+      }
+      for (t = 0; t < threads; t++) {
+	 pthread_join(tid[t], NULL);
+	 hits += b[t].hits;
+      }
+      free(tid);
+      free(b);
+   }
+   else
+#endif
+   {
+      one.state = random_state;
+      one.its = its;
+      count_hits(&one);
+      hits = one.hits;
    }
    printf("%.10f\n", (double)4.0 * (double) ((double)hits / (double)its));
    return 0;
 }
-
@@ -1,31 +1,112 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef THREADS
+#ifndef CUSTOM_RANDOM
+#error "-DTHREADS needs -DCUSTOM_RANDOM, to jump ahead in random.c"
+#endif
+#include <string.h>
+#include <pthread.h>
+#endif
+
 #ifdef CUSTOM_RANDOM
 #include "random.c"
+#define RANDOM(s) random_next(s)
+#else
+// libc random() keeps its own state
+#define RANDOM(s) random()
+#define random_state 0
 #endif
 
 #define PRECISION 3
 // radius of circle, must be 10^PRECISION
 #define RADIUS 1000
 
-int main(int argc, char *argv[])
+// one block of samples, drawing from *state
+struct block {
+   unsigned long state;
+   unsigned int its, hits;
+};
+
+static void *count_hits(void *arg)
 {
-   unsigned int i, its, hits = 0;
+   struct block *b = arg;
+   unsigned int i, hits = 0;
    unsigned int i1, i2;
 
+   for (i = 0; i < b->its; i++) {
+       i1 = RANDOM(&b->state) % RADIUS;
+       i2 = RANDOM(&b->state) % RADIUS;
+       if ((i1*i1 + i2*i2) <= RADIUS*RADIUS)
+           hits++;
+   }
+   b->hits = hits;
+   return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned int its, hits = 0;
+   struct block one;
+
+#ifdef THREADS
+   int t, threads = 1;
+
+   if (argc == 4 && strcmp(argv[1], "-t") == 0) {
+      threads = atoi(argv[2]);
+      argv[2] = argv[0];
+      argc -= 2;
+      argv += 2;
+   }
+   if (argc != 2 || threads < 1) {
+      fprintf(stderr, "Usage: %s [-t threads] <iterations>\n", argv[0]);
+      exit(0);
+   }
+#else
    if (argc != 2) {
       fprintf(stderr, "Usage: %s <iterations>\n", argv[0]);
       exit(0);
    }
+#endif
 
    its = atoi(argv[1]);
    srandom(1);
-   for (i = 0; i < its; i++) {
-       i1 = random() % RADIUS;
-       i2 = random() % RADIUS;
-       if ((i1*i1 + i2*i2) <= RADIUS*RADIUS)
-           hits++;
+#ifdef THREADS
+   // Sample i takes draws 2i and 2i+1 of the one sequence whatever the
+   // number of threads, so the estimate does not depend on it.
+   if (threads > 1) {
+      struct block *b = malloc(threads * sizeof(*b));
+      pthread_t *tid = malloc(threads * sizeof(*tid));
+      unsigned int start = 0, end;
+
+      if (!b || !tid) {
+          fprintf(stderr, "Out of memory.\n");
+          exit(1);
+      }
+      for (t = 0; t < threads; t++, start = end) {
+          end = (unsigned int)((unsigned long long)its * (t + 1) / threads);
+          b[t].state = random_state;
+          random_jump(&b[t].state, 2 * (uint64_t)start);
+          b[t].its = end - start;
+          if (pthread_create(&tid[t], NULL, count_hits, &b[t])) {
+              fprintf(stderr, "Cannot create thread.\n");
+              exit(1);
+          }
+      }
+      for (t = 0; t < threads; t++) {
+          pthread_join(tid[t], NULL);
+          hits += b[t].hits;
+      }
+      free(tid);
+      free(b);
+   }
+   else
+#endif
+   {
+      one.state = random_state;
+      one.its = its;
+      count_hits(&one);
+      hits = one.hits;
    }
    
    unsigned int approx = (hits*4*RADIUS / its);
@@ -37,4 +118,3 @@ int main(int argc, char *argv[])
    printf(make_format(PRECISION), whole, decimal);
    return 0;
 }
-
@@ -1,11 +1,27 @@
+/*
+ * Minimal standard (Park-Miller) replacement for libc random(), for
+ * targets without one. There is no header: a benchmark built with
+ * -DCUSTOM_RANDOM #includes this file (qsort through a symlink), so
+ * the declarations below are the interface.
+ *
+ * random(), srandom()  drop-in replacements, on random_state
+ * random_next()        the next value of an explicit state
+ * random_jump()        advance a state by n steps in O(log n)
+ * random_split()       start k disjoint substreams from one seed
+ */
+
 #include <stdint.h>
 
+long random_next(unsigned long *state);
+void random_jump(unsigned long *state, uint64_t n);
+int random_split(unsigned int seed, unsigned long *state, int k);
+
 unsigned long random_state = 0;
 
-long random(void)
+long random_next(unsigned long *state)
 {
     uint32_t i;
-    i = random_state;
+    i = *state;
     
 /*
  * Compute x = (7^5 * x) mod (2^31 - 1)
@@ -26,15 +42,67 @@ long random(void)
     x = 16807 * lo - 2836 * hi;
     if (x < 0)
         x += 0x7fffffff;
-    random_state = i = x & 0x7fffffff;
+    *state = i = x & 0x7fffffff;
     
     return (long)i;
 }
 
-void srandom(unsigned long x)
+long random(void)
+{
+    return random_next(&random_state);
+}
+
+/*
+ * Advance state by n steps, as if random_next() had been called n
+ * times, in O(log n). From a state x in 1..2^31-2, k steps give
+ * x * 16807^k mod (2^31 - 1), and 16807^k is found by repeated
+ * squaring; the products fit in 62 bits. Other states (0, or 2^31-1
+ * and up) are stepped singly first; that takes at most two steps.
+ */
+void random_jump(unsigned long *state, uint64_t n)
+{
+    uint64_t a = 16807, an = 1;
+    
+    for (; n != 0 && (*state == 0 || *state >= 0x7fffffff); n--)
+        (void)random_next(state);
+    if (n == 0)
+        return;
+    for (; n != 0; n >>= 1) {
+        if (n & 1)
+            an = an * a % 0x7fffffff;
+        a = a * a % 0x7fffffff;
+    }
+    *state = (unsigned long)(*state * an % 0x7fffffff);
+}
+
+void srandom(unsigned int x)
 {
     int i;
     random_state = x;
     for (i = 0; i < 50; ++i)
         (void)random();
 }
+
+/*
+ * Split the stream that srandom(seed) would start into k disjoint
+ * substreams. state[0] starts where srandom() leaves random_state, and
+ * each state[j] (2^31 - 2) / k steps after state[j-1], so every
+ * substream can draw that many values before it runs into the next.
+ * Returns k, or 0 (filling in nothing) if k is less than 1.
+ */
+int random_split(unsigned int seed, unsigned long *state, int k)
+{
+    uint64_t stride;
+    int j;
+    
+    if (k < 1)
+        return 0;
+    stride = 0x7ffffffe / k;
+    state[0] = seed;
+    random_jump(&state[0], 50);     /* the values srandom() discards */
+    for (j = 1; j < k; ++j) {
+        state[j] = state[j - 1];
+        random_jump(&state[j], stride);
+    }
+    return k;
+}
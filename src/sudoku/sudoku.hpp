@@ -0,0 +1,177 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku.hpp                                                                 */
+/* Language: C++17                                                                  */
+/*                                                                                  */
+/* A thin, header only C++ wrapper for the sudoku solver engine (libsudoku). It     */
+/* owns a solver context (see the iterator API in sudoku_engine.h) and reuses it    */
+/* for every puzzle, so solving does not allocate: puzzles are taken as             */
+/* std::string_view and read in place, and answers are written to buffers owned     */
+/* by the caller.                                                                   */
+/*                                                                                  */
+/* The engine settings made by init_solve_engine() (callback, first solution only,  */
+/* explanation) are process wide, and must be made before a Solver is constructed.  */
+/* Each Solver may only be used by one thread at a time.                            */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#ifndef _SUDOKU_HPP_
+#define _SUDOKU_HPP_
+
+#include <cstddef>
+#include <string_view>
+
+#include "sudoku_engine.h"
+
+namespace sudoku {
+
+/* An answer as written by format_answer(): 81 characters and a NUL */
+typedef char Answer[PUZZLE_CELLS + 1];
+
+/* Outcome of Solver::solve() */
+struct Result {
+	bool valid;			/* false if the puzzle was bogus          */
+        int status;			/* SOLVE_OK, SOLVE_TIMEOUT, etc. or, for  */
+        				/* a bogus puzzle, SOLVE_BADFORMAT, etc.  */
+        unsigned int solncount;		/* solutions found                        */
+        std::size_t stored;		/* answers written to the caller's buffer */
+        unsigned int score;
+        int maxlvl;
+};
+
+/*****************************************************************/
+/* Setup the engine, see init_solve_engine(). Returns the engine */
+/* version string.                                               */
+/*****************************************************************/
+
+inline const char *init(bool first_soln_only = false, RETURN_SOLN callback = nullptr)
+{
+	return init_solve_engine(callback, nullptr, nullptr, first_soln_only, 0);
+}
+
+class Solver {
+public:
+	Solver() : ctx(solver_create()) {}
+
+        explicit Solver(const SOLVE_LIMITS &lim) : ctx(solver_create())
+        {
+        	solver_limits(ctx, &lim);
+        }
+
+        ~Solver()
+        {
+        	if (ctx) solver_destroy(ctx);
+        }
+
+        Solver(const Solver &) = delete;
+        Solver &operator=(const Solver &) = delete;
+
+        Solver(Solver &&other) noexcept : ctx(other.ctx)
+        {
+        	other.ctx = nullptr;
+        }
+
+        Solver &operator=(Solver &&other) noexcept
+        {
+        	if (this != &other) {
+                	if (ctx) solver_destroy(ctx);
+                        ctx = other.ctx;
+                        other.ctx = nullptr;
+                }
+                return *this;
+        }
+
+        /* Budgets for the puzzles solved from now on */
+        void limits(const SOLVE_LIMITS &lim)
+        {
+        	solver_limits(ctx, &lim);
+        }
+
+        /*********************************************************/
+        /* Iterate over the solutions of a puzzle by hand: load, */
+        /* then call next() until it returns nullptr. Only the   */
+        /* first 81 characters of the puzzle are read.           */
+        /*********************************************************/
+
+        bool load(std::string_view puzzle)
+        {
+        	return puzzle.size() >= PUZZLE_CELLS && solver_load(ctx, puzzle.data());
+        }
+
+        const Grid *next()
+        {
+        	return solver_next(ctx);
+        }
+
+        const Grid *grid() const
+        {
+        	return solver_grid(ctx);
+        }
+
+        SOLVE_STATS stats() const
+        {
+        	SOLVE_STATS st;
+
+                solver_stats(ctx, &st);
+                return st;
+        }
+
+        /*********************************************************/
+        /* Solve a puzzle, writing up to max_answers solutions   */
+        /* to the answers buffer. The search still runs to the   */
+        /* end, so solncount counts all solutions (or the first, */
+        /* if the engine was so initialized.)                    */
+        /*********************************************************/
+
+        Result solve(std::string_view puzzle, Answer *answers, std::size_t max_answers)
+        {
+        	Result res = { false, SOLVE_OK, 0, 0, 0, 0 };
+                const Grid *g;
+                SOLVE_STATS st;
+
+                /* Say why a bogus puzzle was turned down */
+                if (!load(puzzle)) {
+                	res.status = puzzle.size() < PUZZLE_CELLS ? SOLVE_BADFORMAT : stats().status;
+                        return res;
+                }
+
+                while ((g = next()) != nullptr) {
+                	if (res.stored < max_answers) format_answer(g, answers[res.stored++]);
+                }
+
+                solver_stats(ctx, &st);
+                res.valid = true;
+                res.status = st.status;
+                res.solncount = st.solncount;
+                res.score = st.score;
+                res.maxlvl = st.maxlvl;
+
+                return res;
+        }
+
+        template <std::size_t N>
+        Result solve(std::string_view puzzle, Answer (&answers)[N])
+        {
+        	return solve(puzzle, answers, N);
+        }
+
+        /* The underlying context, for the rest of the C API */
+        SOLVER_CTX *get() const
+        {
+        	return ctx;
+        }
+
+private:
+	SOLVER_CTX *ctx;
+};
+
+} /* namespace sudoku */
+
+#endif
@@ -197,6 +197,10 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
+#ifdef THREADS
+#include <pthread.h>
+#endif
 
 #include "sudoku_engine.h"
 
@@ -204,7 +208,14 @@
 
 static inline int is_given(int c) { return (c >= '1') && (c <= '9'); }
 
-static int add_soln(Grid *g);
+/* Accessors for the solved and given cell bitmaps */
+#define MAP_BIT(c)		(1u << ((c) & 31))
+#define IS_SOLVED(g, c)		((g)->solvedmap[(c) >> 5] & MAP_BIT(c))
+#define IS_GIVEN(g, c)		((g)->givenmap[(c) >> 5] & MAP_BIT(c))
+#define MARK_SOLVED(g, c)	((g)->solvedmap[(c) >> 5] |= MAP_BIT(c))
+#define MARK_GIVEN(g, c)	((g)->givenmap[(c) >> 5] |= MAP_BIT(c), MARK_SOLVED((g), (c)))
+#define CLEAR_SOLVED(g, c)	((g)->solvedmap[(c) >> 5] &= ~MAP_BIT(c))
+#define CLEAR_GIVEN(g, c)	((g)->givenmap[(c) >> 5] &= ~MAP_BIT(c))
 
 /*********************************************/
 /*** BEGIN configurable sudoku_engine vars ***/
@@ -212,23 +223,28 @@ static int add_soln(Grid *g);
 static FILE *rejects = NULL;
 static int enumerate_all = 1;
 static RETURN_SOLN soln_callback = NULL;
+static SOLVE_LIMITS limits = { 0, 0, NULL, 0, 0 };
+static int rule_schedule = SCHED_STATIC;
+static int uniqueness = UNIQUE_OFF;
+static int probing = 0;
 
+static int explain = 0;
 #ifdef EXPLAIN
 static FILE *solnfile = NULL;
-static int explain = 0;
 #endif
 
 /***  END configurable sudoku_engine vars  ***/
 /*********************************************/
 
-static int lvl = 0;
-static int abort_mission = 0;
+static int initialized = 0;
 
-static Grid *soln_list = NULL;
+#ifdef EXPLAIN
+static int lvl = 0;		/* level of the search being explained */
+#endif
 
 /* This is the list of cell coordinates specified on a row basis */
 
-static int const row[PUZZLE_DIM][PUZZLE_DIM] = {
+static uint8_t const row[PUZZLE_DIM][PUZZLE_DIM] = {
  {  0,  1,  2,  3,  4,  5,  6,  7,  8 },
  {  9, 10, 11, 12, 13, 14, 15, 16, 17 },
  { 18, 19, 20, 21, 22, 23, 24, 25, 26 },
@@ -241,7 +257,7 @@ static int const row[PUZZLE_DIM][PUZZLE_DIM] = {
 
 /* This is the list of cell coordinates specified on a column basis */
 
-static int const col[PUZZLE_DIM][PUZZLE_DIM] = {
+static uint8_t const col[PUZZLE_DIM][PUZZLE_DIM] = {
  {  0,  9, 18, 27, 36, 45, 54, 63, 72 },
  {  1, 10, 19, 28, 37, 46, 55, 64, 73 },
  {  2, 11, 20, 29, 38, 47, 56, 65, 74 },
@@ -254,7 +270,7 @@ static int const col[PUZZLE_DIM][PUZZLE_DIM] = {
 
 /* This is the list of cell coordinates specified on a 3x3 box basis */
 
-static int const box[PUZZLE_DIM][PUZZLE_DIM] = {
+static uint8_t const box[PUZZLE_DIM][PUZZLE_DIM] = {
  {  0,  1,  2,  9, 10, 11, 18, 19, 20 },
  {  3,  4,  5, 12, 13, 14, 21, 22, 23 },
  {  6,  7,  8, 15, 16, 17, 24, 25, 26 },
@@ -266,7 +282,7 @@ static int const box[PUZZLE_DIM][PUZZLE_DIM] = {
  { 60, 61, 62, 69, 70, 71, 78, 79, 80 }};
 
 typedef struct {
-	int row, col, box;
+	uint8_t row, col, box;
 } cellmap;
 
 /* Array structure to help map cell index back to row, column, and box */
@@ -444,7 +460,7 @@ static const TUPLE_LIST_INFO tuples_list[9] = {
 #define PEER_LEN ((PUZZLE_DIM - 1) * 2 + PUZZLE_DIM - (2 * PUZZLE_ORDER - 1))
 
 /* Enumerate each cell's peers */
-static const int peers[PUZZLE_CELLS][PEER_LEN] = {
+static const uint8_t peers[PUZZLE_CELLS][PEER_LEN] = {
  { 1, 2, 3, 4, 5, 6, 7, 8, 9, 18, 27, 36, 45, 54, 63, 72, 10, 11, 19, 20 }, 
  { 0, 2, 3, 4, 5, 6, 7, 8, 10, 19, 28, 37, 46, 55, 64, 73, 9, 11, 18, 20 }, 
  { 0, 1, 3, 4, 5, 6, 7, 8, 11, 20, 29, 38, 47, 56, 65, 74, 9, 10, 18, 19 },
@@ -527,6 +543,35 @@ static const int peers[PUZZLE_CELLS][PEER_LEN] = {
  { 72, 73, 74, 75, 76, 77, 78, 80, 7, 16, 25, 34, 43, 52, 61, 70, 60, 62, 69, 71 },  
  { 72, 73, 74, 75, 76, 77, 78, 79, 8, 17, 26, 35, 44, 53, 62, 71, 60, 61, 69, 70 }};
 
+/*****************************************************************/
+/* The units and peers of the layout chosen with set_layout(),   */
+/* built by init_solve_engine(). Rows, columns and boxes (or the */
+/* regions of a jigsaw) come first, then any extra units. The    */
+/* classic kernels use the fixed tables above instead; these are */
+/* for the layout kernels and for the code off the hot path.     */
+/*****************************************************************/
+
+#define MAX_UNITS (3 * PUZZLE_DIM + 4)	/* windoku: rows, columns, boxes, windows */
+#define MAX_PEERS 32			/* the centre cell of an X-sudoku         */
+
+typedef struct layout {
+	int kind;				/* LAYOUT_CLASSIC etc.             */
+        int units;				/* number of units                 */
+        int min_givens;				/* fewer cannot have a unique soln */
+        const char *extra_name;			/* what the extra units are called */
+        uint8_t unit[MAX_UNITS][PUZZLE_DIM];
+        uint8_t npeers[PUZZLE_CELLS];
+        uint8_t peers[PUZZLE_CELLS][MAX_PEERS];
+} Layout;
+
+static Layout layout;
+static int layout_kind = LAYOUT_CLASSIC;		/* as set by set_layout() */
+static char layout_regions[PUZZLE_CELLS];
+
+/* The kind of unit u of the layout (UNIT_ROW etc.), and its number among those of its kind */
+#define UNIT_KIND(u)   ((u) < 3 * PUZZLE_DIM ? UNIT_ROW + (u) / PUZZLE_DIM : UNIT_EXTRA)
+#define UNIT_NUMBER(u) ((u) < 3 * PUZZLE_DIM ? (u) % PUZZLE_DIM : (u) - 3 * PUZZLE_DIM)
+
 /* Function prototype(s) */
 
 #if defined(DEBUG)
@@ -546,7 +591,7 @@ static void mypause()
  
 static inline short bitcount(short cell)
 {
-        static const short bcounts[512] = {
+        static const uint8_t bcounts[512] = {
         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
         1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
         1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,2,3,3,4,3,4,4,5,3,4,4,5,4,5,5,6,
@@ -567,10 +612,23 @@ static inline short bitcount(short cell)
         return bcounts[cell];
 }
 
+/*****************************************************/
+/* Raise the difficulty rating of a grid to at least */
+/* the grade of the rule just applied.               */
+/*****************************************************/
+
+static inline void bump_rating(Grid *g, int rating)
+{
+	if (g->rating < rating) g->rating = rating;
+}
+
 /******************************************************************/
 /* Construct a string representing the possible values a cell may */
-/* contain according to current markup.                           */
+/* contain according to current markup. The longest string is     */
+/* "tuple (1, 2, 3, 4, 5, 6, 7, 8, 9)", with its NUL 34 bytes.    */
 /******************************************************************/
+#define CLUES_LEN 48
+
 static char *clues(short cell, char *buf)
 {
 	int i, m, multi, mask;
@@ -623,7 +681,7 @@ static inline void explain_indent(FILE *h)
 static void explain_markup_elim(Grid *g, int chgd, int clue)
 {
 	int chgd_row, chgd_col, clue_row, clue_col;
-        char buf[32];
+        char buf[CLUES_LEN];
 
         chgd_row = map[chgd].row+1;
         chgd_col = map[chgd].col+1;
@@ -655,7 +713,7 @@ static void explain_current_markup(Grid *g)
 static void explain_solve_cell(Grid *g, int chgd)
 {
 	int chgd_row, chgd_col;
-        char buf[32];
+        char buf[CLUES_LEN];
 
         chgd_row = map[chgd].row+1;
         chgd_col = map[chgd].col+1;
@@ -679,7 +737,7 @@ static void explain_markup_impasse(Grid *g, int chgd, int clue)
 
         explain_indent(solnfile);
         fprintf(solnfile, "Impasse for cell at row %d, col %d because cell at row %d, col %d removes %s\n",
-                chgd_row, chgd_col, clue_row, clue_col, g->cellflags[chgd] == GIVEN ? "a given clue" : "the last candidate");
+                chgd_row, chgd_col, clue_row, clue_col, IS_GIVEN(g, chgd) ? "a given clue" : "the last candidate");
         explain_current_markup(g);
 }
 
@@ -689,7 +747,7 @@ static void explain_markup_impasse(Grid *g, int chgd, int clue)
 static void explain_singleton(Grid *g, int chgd, int mask, char *vdesc)
 {
 	int chgd_row, chgd_col, chgd_box;
-        char buf[32];
+        char buf[CLUES_LEN];
 
         chgd_row = map[chgd].row+1;
         chgd_col = map[chgd].col+1;
@@ -730,7 +788,7 @@ static void explain_given(int cell, char val)
 static void explain_vector_elim(char *desc, int chute, int cell, int val, int box_tuple)
 {
 	int cell_row, cell_col;
-        char buf1[32], buf2[32];
+        char buf1[CLUES_LEN], buf2[CLUES_LEN];
 
         cell_row = map[cell].row+1;
         cell_col = map[cell].col+1;
@@ -746,7 +804,7 @@ static void explain_vector_elim(char *desc, int chute, int cell, int val, int bo
 static void explain_vector_impasse(Grid *g, char *desc, int chute, int cell, int val, int box_tuple)
 {
 	int cell_row, cell_col;
-        char buf1[32], buf2[32];
+        char buf1[CLUES_LEN], buf2[CLUES_LEN];
 
         cell_row = map[cell].row+1;
         cell_col = map[cell].col+1;
@@ -762,7 +820,7 @@ static void explain_vector_impasse(Grid *g, char *desc, int chute, int cell, int
 /*****************************************************************/
 static void explain_tuple_impasse(Grid *g, char *desc, int elt, int tuple, int count, int bits)
 {
-	char buf[32];
+	char buf[CLUES_LEN];
 
         explain_indent(solnfile);
         fprintf(solnfile, "Impasse in %s %d because too many (%d) cells have %d-valued %s\n",
@@ -775,7 +833,7 @@ static void explain_tuple_impasse(Grid *g, char *desc, int elt, int tuple, int c
 /*********************************************************************/
 static void explain_tuple_elim(char *desc, int elt, int tuple, int cell)
 {
-	char buf[32];
+	char buf[CLUES_LEN];
 
         explain_indent(solnfile);
         fprintf(solnfile, "Value of %s in %s %d removed from cell at row %d, col %d\n",
@@ -783,6 +841,83 @@ static void explain_tuple_elim(char *desc, int elt, int tuple, int cell)
 
 }
 
+/*****************************************************************/
+/* Explain the removal of a pair of candidates from the fourth   */
+/* corner of a unique rectangle.                                 */
+/*****************************************************************/
+static void explain_unique_elim(int a, int b, int c, int d, int pair)
+{
+	char buf[CLUES_LEN];
+
+        explain_indent(solnfile);
+        fprintf(solnfile, "Values of %s removed from cell at row %d, col %d to avoid a unique rectangle with cells at "
+        	"row %d, col %d, row %d, col %d and row %d, col %d\n", clues(pair, buf), map[d].row+1, map[d].col+1,
+                map[a].row+1, map[a].col+1, map[b].row+1, map[b].col+1, map[c].row+1, map[c].col+1);
+}
+
+/*****************************************************************/
+/* Explain the impasse of a unique rectangle already formed.     */
+/*****************************************************************/
+static void explain_unique_impasse(Grid *g, int a, int d, int pair)
+{
+	char buf[CLUES_LEN];
+
+        explain_indent(solnfile);
+        fprintf(solnfile, "Impasse because the rectangle with corners at row %d, col %d and row %d, col %d "
+        	"only holds %s, so the solution would not be unique\n",
+                map[a].row+1, map[a].col+1, map[d].row+1, map[d].col+1, clues(pair, buf));
+        explain_current_markup(g);
+}
+
+/*****************************************************************/
+/* Explain the solving of the odd cell out of a BUG+1 pattern.   */
+/*****************************************************************/
+static void explain_bug(Grid *g, int cell)
+{
+	char buf[CLUES_LEN];
+
+        explain_indent(solnfile);
+        fprintf(solnfile, "Cell at row %d, col %d solved with value %s, as otherwise every unsolved cell would "
+        	"have two candidates and the solution would not be unique (BUG+1)\n",
+                map[cell].row+1, map[cell].col+1, clues(g->cell[cell], buf));
+}
+
+/*****************************************************************/
+/* Explain the removal of a candidate that failed when probed.   */
+/*****************************************************************/
+static void explain_probe_elim(int cell, int mask)
+{
+	char buf[CLUES_LEN];
+
+        explain_indent(solnfile);
+        fprintf(solnfile, "Candidate %s removed from cell at row %d, col %d because assigning it leads to an impasse\n",
+        	clues(mask, buf), map[cell].row+1, map[cell].col+1);
+}
+
+/*****************************************************************/
+/* Explain candidates removed because neither value of a probed  */
+/* bivalue cell leaves them.                                     */
+/*****************************************************************/
+static void explain_probe_agree(int probe, int cell, int mask)
+{
+	char buf[CLUES_LEN];
+
+        explain_indent(solnfile);
+        fprintf(solnfile, "Candidate %s removed from cell at row %d, col %d because both values of the cell at row %d, col %d remove it\n",
+        	clues(mask, buf), map[cell].row+1, map[cell].col+1, map[probe].row+1, map[probe].col+1);
+}
+
+/*****************************************************************/
+/* Explain the impasse of a cell for which both values fail.     */
+/*****************************************************************/
+static void explain_probe_impasse(Grid *g, int cell)
+{
+        explain_indent(solnfile);
+        fprintf(solnfile, "Impasse for cell at row %d, col %d because both of its candidates lead to an impasse\n",
+        	map[cell].row+1, map[cell].col+1);
+        explain_current_markup(g);
+}
+
 /**************************************************/
 /* Indicate that a viable solution has been found */
 /**************************************************/
@@ -815,7 +950,7 @@ static void explain_grid(Grid *g)
 /*************************************************/
 static void explain_trial(int cell, int value)
 {
-	char buf[32];
+	char buf[CLUES_LEN];
 
         explain_indent(solnfile);
         fprintf(solnfile, "Attempt trial where cell at row %d, col %d is assigned value %s\n",
@@ -833,27 +968,41 @@ static void explain_backtrack()
         fprintf(solnfile, "Backtracking\n\n");
 }
 
-#define EXPLAIN_MARKUP                                 if (explain) explain_markup()
-#define EXPLAIN_CURRENT_MARKUP(g)                      if (explain) explain_current_markup((g))
-#define EXPLAIN_GIVEN(cell, val)	               if (explain) explain_given((cell), (val))
-#define EXPLAIN_MARKUP_ELIM(g, chgd, clue)             if (explain) explain_markup_elim((g), (chgd), (clue))
-#define EXPLAIN_MARKUP_SOLVE(g, cell)                  if (explain) explain_solve_cell((g), (cell)) 
-#define EXPLAIN_MARKUP_IMPASSE(g, chgd, clue)          if (explain) explain_markup_impasse((g), (chgd), (clue))
-#define EXPLAIN_SINGLETON(g, chgd, mask, vdesc)        if (explain) explain_singleton((g), (chgd), (mask), (vdesc))
-#define EXPLAIN_VECTOR_ELIM(desc, i, cell, v, r)       if (explain) explain_vector_elim((desc), (i), (cell), (v), (r))
-#define EXPLAIN_VECTOR_IMPASSE(g, desc, i, cell, v, r) if (explain) explain_vector_impasse((g), (desc), (i), (cell), (v), (r))
-#define EXPLAIN_VECTOR_SOLVE(g, cell)                  if (explain) explain_solve_cell((g), (cell)) 
-#define EXPLAIN_TUPLE_IMPASSE(g, desc, j, c, count, i) if (explain) explain_tuple_impasse((g), (desc), (j), (c), (count), (i))
-#define EXPLAIN_TUPLE_ELIM(desc, j, c, cell)           if (explain) explain_tuple_elim((desc), (j), (c), (cell))
-#define EXPLAIN_TUPLE_SOLVE(g, cell)                   if (explain) explain_solve_cell((g), (cell)) 
-#define EXPLAIN_SOLN_FOUND(g)			       if (explain) explain_soln_found((g));
-#define EXPLAIN_GRID(g)			               if (explain) explain_grid((g));
-#define EXPLAIN_TRIAL(cell, val)		       if (explain) explain_trial((cell), (val));
-#define EXPLAIN_BACKTRACK                              if (explain) explain_backtrack();
-#define EXPLAIN_INDENT(h)			       if (explain) explain_indent((h))
+/* The hooks are live where EXPLAIN_HOOKS is 1, which is everywhere */
+/* but the plain kernels (see below), where they compile away.       */
+#define EXPLAIN_HOOKS 1
+
+#define EXPLAIN_MARKUP                                 if (EXPLAIN_HOOKS && explain) explain_markup()
+#define EXPLAIN_CURRENT_MARKUP(g)                      if (EXPLAIN_HOOKS && explain) explain_current_markup((g))
+#define EXPLAIN_GIVEN(cell, val)                       if (EXPLAIN_HOOKS && explain) explain_given((cell), (val))
+#define EXPLAIN_MARKUP_ELIM(g, chgd, clue)             if (EXPLAIN_HOOKS && explain) explain_markup_elim((g), (chgd), (clue))
+#define EXPLAIN_MARKUP_SOLVE(g, cell)                  if (EXPLAIN_HOOKS && explain) explain_solve_cell((g), (cell))
+#define EXPLAIN_MARKUP_IMPASSE(g, chgd, clue)          if (EXPLAIN_HOOKS && explain) explain_markup_impasse((g), (chgd), (clue))
+#define EXPLAIN_SINGLETON(g, chgd, mask, vdesc)        if (EXPLAIN_HOOKS && explain) explain_singleton((g), (chgd), (mask), (vdesc))
+#define EXPLAIN_VECTOR_ELIM(desc, i, cell, v, r)       if (EXPLAIN_HOOKS && explain) explain_vector_elim((desc), (i), (cell), (v), (r))
+#define EXPLAIN_VECTOR_IMPASSE(g, desc, i, cell, v, r) if (EXPLAIN_HOOKS && explain) explain_vector_impasse((g), (desc), (i), (cell), (v), (r))
+#define EXPLAIN_VECTOR_SOLVE(g, cell)                  if (EXPLAIN_HOOKS && explain) explain_solve_cell((g), (cell))
+#define EXPLAIN_TUPLE_IMPASSE(g, desc, j, c, count, i) if (EXPLAIN_HOOKS && explain) explain_tuple_impasse((g), (desc), (j), (c), (count), (i))
+#define EXPLAIN_TUPLE_ELIM(desc, j, c, cell)           if (EXPLAIN_HOOKS && explain) explain_tuple_elim((desc), (j), (c), (cell))
+#define EXPLAIN_TUPLE_SOLVE(g, cell)                   if (EXPLAIN_HOOKS && explain) explain_solve_cell((g), (cell))
+#define EXPLAIN_UNIQUE_ELIM(a, b, c, d, m)             if (EXPLAIN_HOOKS && explain) explain_unique_elim((a), (b), (c), (d), (m))
+#define EXPLAIN_UNIQUE_IMPASSE(g, a, d, m)             if (EXPLAIN_HOOKS && explain) explain_unique_impasse((g), (a), (d), (m))
+#define EXPLAIN_UNIQUE_SOLVE(g, cell)                  if (EXPLAIN_HOOKS && explain) explain_solve_cell((g), (cell))
+#define EXPLAIN_BUG(g, cell)                           if (EXPLAIN_HOOKS && explain) explain_bug((g), (cell))
+#define EXPLAIN_PROBE_ELIM(cell, m)                    if (EXPLAIN_HOOKS && explain) explain_probe_elim((cell), (m))
+#define EXPLAIN_PROBE_AGREE(c, cell, m)                if (EXPLAIN_HOOKS && explain) explain_probe_agree((c), (cell), (m))
+#define EXPLAIN_PROBE_IMPASSE(g, cell)                 if (EXPLAIN_HOOKS && explain) explain_probe_impasse((g), (cell))
+#define EXPLAIN_PROBE_SOLVE(g, cell)                   if (EXPLAIN_HOOKS && explain) explain_solve_cell((g), (cell))
+#define EXPLAIN_SOLN_FOUND(g)                          if (EXPLAIN_HOOKS && explain) explain_soln_found((g));
+#define EXPLAIN_GRID(g)                                if (EXPLAIN_HOOKS && explain) explain_grid((g));
+#define EXPLAIN_TRIAL(cell, val)                       if (EXPLAIN_HOOKS && explain) explain_trial((cell), (val));
+#define EXPLAIN_BACKTRACK                              if (EXPLAIN_HOOKS && explain) explain_backtrack();
+#define EXPLAIN_INDENT(h)                              if (EXPLAIN_HOOKS && explain) explain_indent((h))
 
 #else
 
+#define EXPLAIN_HOOKS 0
+
 #define EXPLAIN_MARKUP
 #define EXPLAIN_CURRENT_MARKUP(g)
 #define EXPLAIN_GIVEN(cell, val)
@@ -867,6 +1016,14 @@ static void explain_backtrack()
 #define EXPLAIN_TUPLE_IMPASSE(g, desc, j, c, count, i)
 #define EXPLAIN_TUPLE_ELIM(desc, j, c, cell)
 #define EXPLAIN_TUPLE_SOLVE(g, cell)
+#define EXPLAIN_UNIQUE_ELIM(a, b, c, d, m)
+#define EXPLAIN_UNIQUE_IMPASSE(g, a, d, m)
+#define EXPLAIN_UNIQUE_SOLVE(g, cell)
+#define EXPLAIN_BUG(g, cell)
+#define EXPLAIN_PROBE_ELIM(cell, m)
+#define EXPLAIN_PROBE_AGREE(c, cell, m)
+#define EXPLAIN_PROBE_IMPASSE(g, cell)
+#define EXPLAIN_PROBE_SOLVE(g, cell)
 #define EXPLAIN_SOLN_FOUND(g)
 #define EXPLAIN_GRID(g)
 #define EXPLAIN_TRIAL(cell, val)
@@ -891,8 +1048,9 @@ static void init_grid(Grid *g)
 
         for (i = 0; i < PUZZLE_CELLS; i++) {
 		g->cell[i] = 0x01ff;
-                g->cellflags[i] = UNSOLVED;
         }
+        memset(g->solvedmap, 0, sizeof(g->solvedmap));
+        memset(g->givenmap, 0, sizeof(g->givenmap));
         g->exposed = 0;
         g->givens = 0;
         g->inc = 0;
@@ -900,9 +1058,8 @@ static void init_grid(Grid *g)
         g->score = 0;
         g->solncount = 0;
         g->reward = 1;
-        g->next = NULL;
+        g->rating = RATE_GIVENS;
         g->tail = 0;
-        EXPLAIN_MARKUP;
 }
 
 /*****************************************************/
@@ -920,12 +1077,13 @@ static int cvt_to_grid(Grid *g, const char *game)
 	int i;
 
         init_grid(g);
+        EXPLAIN_MARKUP;
 
         for (i = 0; i < PUZZLE_CELLS && game[i]; i++) {
         	if (is_given(game[i])) {
 			/* warning -- ASCII charset assumed */
                 	g->cell[i] = 1 << (game[i] - '1');
-                        g->cellflags[i] = GIVEN;
+                        MARK_GIVEN(g, i);
                         g->givens += 1;
                         g->solved[g->exposed++] = i;
                         EXPLAIN_GIVEN(i, game[i]);
@@ -1011,62 +1169,71 @@ void diagnostic_grid(const Grid *g, FILE *h)
         fprintf(h, "+---+---+---+---+---+---+---+---+---+\n");
 }
 
+/*****************************************************************/
+/* Where a puzzle was found to be at fault: a cell, a unit (row, */
+/* column or box) or both. Unset members are -1 or UNIT_NONE.    */
+/*****************************************************************/
+
+typedef struct fault {
+	int unit_type, unit, cell;
+} Fault;
+
+static inline void clear_fault(Fault *f)
+{
+	f->unit_type = UNIT_NONE;
+        f->unit = f->cell = -1;
+}
+
+static inline void note_fault(Fault *f, int unit_type, int unit, int cell)
+{
+	if (f && f->unit_type == UNIT_NONE && f->cell < 0) {
+        	f->unit_type = unit_type;
+                f->unit = unit;
+                f->cell = cell;
+        }
+}
+
+/* Name a kind of unit, e.g. "Row", or "Diagonal" for the extra units of an X-sudoku */
+static const char *unit_name(int kind)
+{
+	static const char *names[] = { "Cell", "Row", "Column", "Box" };
+
+        return kind == UNIT_EXTRA ? layout.extra_name : names[kind];
+}
+
 /***********************************************************************/
 /* Validate that a sudoku grid contains a valid solution. Return 1 if  */
-/* true, 0 if false. If the verbose argument is non-zero, then print   */
-/* reasons for invalidating the solution to "rejects" file.            */
+/* true, 0 if false. If a file is given, then print all reasons for    */
+/* invalidating the solution to it. If a fault is given, then record   */
+/* the first reason found in it. With neither, return at the first.    */
 /***********************************************************************/
 
-static int validate(const Grid *g, int verbose)
+static int validate(const Grid *g, FILE *h, Fault *fault)
 {
-	int i, j, bc, boxmask, rowmask, colmask, flag = 1;
-        char buf[32];
+	int i, j, u, bc, mask, flag = 1;
+        char buf[CLUES_LEN];
 
 	/* Sanity check */
 	for (i = 0; i < PUZZLE_CELLS; i++) {
         	if ((bc = bitcount(g->cell[i])) != 1) {
-                	if (verbose) {
-                                fprintf(rejects, "Cell %d at row %d, col %d %s.\n",
+                	note_fault(fault, UNIT_NONE, -1, i);
+                	if (h) {
+                                fprintf(h, "Cell %d at row %d, col %d %s.\n",
                                         1+i, 1+map[i].row, 1+map[i].col, (bc ? "has no unique solution" :"is at an impasse"));
 	                	flag = 0;
                         } else return 0;
                 }
         }
 
-        /* Check rows */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	for (rowmask = j = 0; j < PUZZLE_DIM; j++) {
-                        if (bitcount(g->cell[row[i][j]]) == 1) rowmask |= g->cell[row[i][j]];
-                }
-                if (rowmask != 0x01ff) {
-                	if (verbose) {
-				fprintf(rejects, "Row %d is not solved for %s.\n", 1+i, clues(~rowmask, buf));
-	                	flag = 0;
-                        } else return 0;
-                }
-        }
-
-        /* Check columns */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	for (colmask = j = 0; j < PUZZLE_DIM; j++) {
-                        if (bitcount(g->cell[col[i][j]]) == 1) colmask |= g->cell[col[i][j]];
+        /* Check rows, columns, boxes and any extra units */
+        for (u = 0; u < layout.units; u++) {
+        	for (mask = j = 0; j < PUZZLE_DIM; j++) {
+                        if (bitcount(g->cell[layout.unit[u][j]]) == 1) mask |= g->cell[layout.unit[u][j]];
                 }
-                if (colmask != 0x01ff) {
-                	if (verbose) {
-				fprintf(rejects, "Column %d is not solved for %s.\n", 1+i, clues(~colmask, buf));
-	                	flag = 0;
-                        } else return 0;
-                }
-        }
-
-        /* Check 3x3 boxes */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	for (boxmask = j = 0; j < PUZZLE_DIM; j++) {
-                        if (bitcount(g->cell[box[i][j]]) == 1) boxmask |= g->cell[box[i][j]];
-                }
-                if (boxmask != 0x01ff) {
-                	if (verbose) {
-				fprintf(rejects, "Box %d is not solved for %s.\n", 1+i, clues(~boxmask, buf));
+                if (mask != 0x01ff) {
+                	note_fault(fault, UNIT_KIND(u), UNIT_NUMBER(u), -1);
+                	if (h) {
+				fprintf(h, "%s %d is not solved for %s.\n", unit_name(UNIT_KIND(u)), 1+UNIT_NUMBER(u), clues(~mask, buf));
 	                	flag = 0;
                         } else return 0;
                 }
@@ -1075,795 +1242,1892 @@ static int validate(const Grid *g, int verbose)
         return flag;
 }
 
-/********************************************************************************/
-/* This function uses the cells with unique values, i.e. the given              */
-/* or subsequently discovered solution values, to eliminate said values         */
-/* as candidates in other as yet unsolved cells in the associated               */
-/* rows, columns, and 3x3 boxes.                                                */
-/*                                                                              */
-/* The function has three possible return values:                               */
-/*   NOCHANGE - Markup did not change during the last pass,                     */
-/*   CHANGE   - Markup was modified, and                                        */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values */
-/********************************************************************************/
+/*****************************************************************/
+/* Check that no digit is given twice in a unit. Return 1 if the */
+/* givens are consistent, otherwise record the unit and the cell */
+/* holding the repeated given, and return 0.                     */
+/*****************************************************************/
 
-static int mark_cells(Grid *g)
+static int check_givens(const Grid *g, Fault *fault)
 {
-        int i, chgflag, bc, ndx;
-        short elt, mask, before, cell;
-
-       	chgflag = NOCHANGE;
-
-	while (g->tail < g->exposed) {
-
-		elt = g->solved[g->tail++];
-
-                mask = ~g->cell[elt];
-
-                for (i = 0; i < PEER_LEN; i++) {
-
-                	/* Get the cell value to change */
-                        ndx = peers[elt][i];
-                        before = cell = g->cell[ndx];
-
-                        /* Eliminate this candidate value whilst preserving other candidate values */
-                        cell &= mask;
-			g->cell[ndx] = cell;
-
-                        /* Did the cell change value? */
-                	if (before != cell) {
-
-				chgflag |= CHANGE;	/* Flag that puzzle markup was changed */
-                                g->score += g->inc;	/* More work means higher scoring      */
-
-                                if (!(bc = bitcount(cell))) {
-                                	EXPLAIN_MARKUP_IMPASSE(g, ndx, elt);
-					return IMPASSE;	/* Crap out if no candidates remain */
-                                }
-
-                                EXPLAIN_MARKUP_ELIM(g, ndx, elt);
-
-                                /* Check if we solved for this cell, i.e. bit count indicates a unique value */
-                                if (bc == 1) {
-					g->cellflags[ndx] = SOLVED;	/* Mark cell as found  */
-                                        g->score += g->reward;		/* Add to puzzle score */
-					g->pass_mods += 1;
-                                        g->solved[g->exposed++] = ndx;
-                                	EXPLAIN_MARKUP_SOLVE(g, ndx);
-                                }
-			}
+	int u, j, c, mask;
+
+        for (u = 0; u < layout.units; u++) {
+        	for (mask = j = 0; j < PUZZLE_DIM; j++) {
+                	c = layout.unit[u][j];
+                        if (!IS_GIVEN(g, c)) continue;
+                        if (mask & g->cell[c]) {
+                        	note_fault(fault, UNIT_KIND(u), UNIT_NUMBER(u), c);
+                                return 0;
+                        }
+                        mask |= g->cell[c];
                 }
         }
 
-        return chgflag;
+        return 1;
 }
 
+/*****************************************************************/
+/* Check a submitted solution against its puzzle, without the    */
+/* solver. The common case, a valid solution, is decided in one  */
+/* pass that the compiler can vectorize: the digits are turned   */
+/* into bits and OR'ed together down the columns, across the     */
+/* rows and within the boxes, and the 27 unit masks AND'ed. Each */
+/* cell holds exactly one bit, so a unit is complete if and only */
+/* if its mask is 0x1ff. Only a failed submission is scanned     */
+/* again, in order, for its first error.                         */
+/*****************************************************************/
 
-/*******************************************************************/
-/* Identify and "solve" all cells that, by reason of their markup, */
-/* can only assume one specific value, i.e. the cell is the only   */
-/* one in a row/column/box (specified by vector) that is           */
-/* able to assume a particular value.                              */
-/*                                                                 */
-/* The function has two possible return values:                    */
-/*   NOCHANGE - Markup did not change during the last pass,        */
-/*   CHANGE   - Markup was modified.                               */
-/*******************************************************************/
-
-static int find_singletons(Grid *g, int const *vector, char *vdesc)
+static int check_submission(const char *puzzle, const char *answer, CHECK_RESULT *res)
 {
-	int i, j, mask, hist[PUZZLE_DIM], value[PUZZLE_DIM], found = NOCHANGE;
-
-	/* We are going to create a histogram of cell candidate values */
-        /* for the specified cell vector (row/column/box).             */
-        /* First set all buckets to zero.                              */
-        memset(hist, 0, sizeof(hist[0])*PUZZLE_DIM);
+	static uint8_t const (* const units[3])[PUZZLE_DIM] = { row, col, box };
+	uint16_t bit[PUZZLE_CELLS], rows[PUZZLE_DIM], cols[PUZZLE_DIM], band[PUZZLE_DIM], all;
+        unsigned int bad, d, p;
+        int t, i, j, c, mask;
+
+        /* Digits to bits, noting bad digits and changed givens */
+        for (bad = i = 0; i < PUZZLE_CELLS; i++) {
+        	d = (unsigned char) answer[i] - '1';
+                p = (unsigned char) puzzle[i] - '1';
+                bad |= (d > 8) | (p <= 8 && p != d);
+                bit[i] = 1 << (d & 15);
+        }
 
-	/* For each possible candidate value... */
-	for (mask = 1, i = 0; i < PUZZLE_DIM; i++) {
+        for (j = 0; j < PUZZLE_DIM; j++) cols[j] = 0;
+        for (all = 0x1ff, i = 0; i < PUZZLE_DIM; i++) {
+        	for (rows[i] = j = 0; j < PUZZLE_DIM; j++) {
+                	rows[i] |= bit[i*PUZZLE_DIM + j];
+                        cols[j] |= bit[i*PUZZLE_DIM + j];
+                }
+                all &= rows[i];
+        }
 
-	        /* For each cell in the vector... */
+        for (i = 0; i < PUZZLE_DIM; i += 3) {
         	for (j = 0; j < PUZZLE_DIM; j++) {
-
-                	/* If the cell may possibly assume this value... */
-        		if (g->cell[vector[j]] & mask) {
-
-                        	if (++hist[i] > 1) break;		/* Bump bucket in histogram */
-                		value[i] = vector[j];			/* Save the cell coordinate */
-                	}
+                	band[j] = bit[i*PUZZLE_DIM + j] | bit[(i+1)*PUZZLE_DIM + j] | bit[(i+2)*PUZZLE_DIM + j];
                 }
-
-                mask <<= 1;
+                for (j = 0; j < PUZZLE_DIM; j += 3) all &= band[j] | band[j+1] | band[j+2];
         }
 
-        /* Examine each bucket in the histogram... */
-        for (mask = 1, i = 0; i < PUZZLE_DIM; i++) {
+        for (j = 0; j < PUZZLE_DIM; j++) all &= cols[j];
+
+        res->unit_type = UNIT_NONE;
+        res->unit = res->cell = -1;
 
-        	/* If the bucket == 1 and the cell is not already solved,  */
-		/* then the cell has a unique solution specified by "mask" */
-        	if (hist[i] == 1 && g->cellflags[value[i]] == UNSOLVED) {
+        if (!bad && all == 0x1ff) return res->status = CHECK_OK;
+
+        /* Find the first error: a bad digit, then a changed given, then a repeat in a unit */
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (answer[i] < '1' || answer[i] > '9') {
+                	res->cell = i;
+                        return res->status = CHECK_BADFORMAT;
+                }
+        }
 
-                	found = CHANGE;			 /* Indicate that markup has been changed */
-                        g->cell[value[i]] = mask;	 /* Assign solution value to cell         */
-                        g->cellflags[value[i]] = SOLVED; /* Mark cell as solved                   */
-                        g->score += g->reward;           /* Bump puzzle score                     */
-                        g->pass_mods += 1;
-                        g->solved[g->exposed++] = value[i];
-                        EXPLAIN_SINGLETON(g, value[i], mask, vdesc);
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (puzzle[i] >= '1' && puzzle[i] <= '9' && puzzle[i] != answer[i]) {
+                	res->cell = i;
+                        return res->status = CHECK_GIVEN;
                 }
+        }
 
-                mask <<= 1;		/* Get next candidate value */
+        for (t = 0; t < 3; t++) {
+        	for (i = 0; i < PUZZLE_DIM; i++) {
+                	for (mask = j = 0; j < PUZZLE_DIM; j++) {
+                        	c = units[t][i][j];
+                                if (mask & bit[c]) {
+                                	res->unit_type = UNIT_ROW + t;
+                                        res->unit = i;
+                                        res->cell = c;
+                                        return res->status = CHECK_UNIT;
+                                }
+                                mask |= bit[c];
+                        }
+                }
         }
 
-	return found;
+        return res->status = CHECK_OK;		/* not reached */
 }
 
+/*****************************************************************/
+/* Check a submitted solution of a puzzle in a variant layout,   */
+/* unit by unit from the layout's tables. Errors are found in    */
+/* the same order as by check_submission().                      */
+/*****************************************************************/
 
-/*******************************************************************/
-/* Find all cells with unique solutions (according to markup)      */
-/* and mark them as found. Do this for each row, column, and       */
-/* box.                                                            */
-/*                                                                 */
-/* The function has two possible return values:                    */
-/*   NOCHANGE - Markup did not change during the last pass,        */
-/*   CHANGE   - Markup was modified.                               */
-/*******************************************************************/
-
-static int eliminate_singles(Grid *g)
+static int check_layout(const char *puzzle, const char *answer, CHECK_RESULT *res)
 {
-	int i, found = NOCHANGE;
+	int u, i, j, c, mask;
 
-        /* Do rows (horizontal chutes) */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	found |= find_singletons(g, row[i], "row");
+        res->unit_type = UNIT_NONE;
+        res->unit = res->cell = -1;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (answer[i] < '1' || answer[i] > '9') {
+                	res->cell = i;
+                        return res->status = CHECK_BADFORMAT;
+                }
         }
 
-        /* Do columns (vertical chutes) */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	found |= find_singletons(g, col[i], "column");
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (puzzle[i] >= '1' && puzzle[i] <= '9' && puzzle[i] != answer[i]) {
+                	res->cell = i;
+                        return res->status = CHECK_GIVEN;
+                }
         }
 
-        /* Do boxes */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	found |= find_singletons(g, box[i], "box");
+        for (u = 0; u < layout.units; u++) {
+        	for (mask = j = 0; j < PUZZLE_DIM; j++) {
+                	c = layout.unit[u][j];
+                        if (mask & (1 << (answer[c] - '1'))) {
+                        	res->unit_type = UNIT_KIND(u);
+                                res->unit = UNIT_NUMBER(u);
+                                res->cell = c;
+                                return res->status = CHECK_UNIT;
+                        }
+                        mask |= 1 << (answer[c] - '1');
+                }
         }
 
-        return found;
+        return res->status = CHECK_OK;
 }
 
-/********************************************************************************/
-/* Solves simple puzzles, i.e. single elimination                               */
-/*                                                                              */
-/* The function has three possible return values:                               */
-/*   NOCHANGE - Markup did not change during the last pass,                     */
-/*   CHANGE   - Markup was modified, and                                        */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values */
-/********************************************************************************/
-static int simple_solver(Grid *g)
-{
-	int i, b, flag, rc = NOCHANGE;
+/*****************************************************************/
+/* The deductive rules are built more than once. The plain       */
+/* kernels have their EXPLAIN_* hooks compiled away, so a solver */
+/* that has no need of explanations pays nothing for them. Under */
+/* EXPLAIN the rules are built again, with the hooks and with an */
+/* _explain suffix on their names, for the kernel set that       */
+/* init_solve_engine() picks when asked for explanations. They   */
+/* are built once more, with a _layout suffix, over the tables   */
+/* of the variant layouts, so the classic kernels keep their     */
+/* fixed tables.                                                 */
+/*****************************************************************/
 
-        /* Mark the unsolved cells with candidate solutions based upon the current set of "givens" and solved cells */
-        for (i = 0;; i++) {
+#define RULES_LAYOUT 0
+#undef EXPLAIN_HOOKS
+#define EXPLAIN_HOOKS 0
+#include "sudoku_rules.h"
 
-        	if (abort_mission) return IMPASSE;
+#ifdef EXPLAIN
+/* The explaining probes run the simple solver without hooks, under this name */
+static inline int simple_solver_plain(Grid *g) { return simple_solver(g); }
+
+#undef EXPLAIN_HOOKS
+#define EXPLAIN_HOOKS 1
+#define mark_cells              mark_cells_explain
+#define find_singletons         find_singletons_explain
+#define eliminate_singles       eliminate_singles_explain
+#define simple_solver           simple_solver_explain
+#define box_row_chute_elim      box_row_chute_elim_explain
+#define box_col_chute_elim      box_col_chute_elim_explain
+#define chute_elimination       chute_elimination_explain
+#define elim_naked_tuples       elim_naked_tuples_explain
+#define naked_tuple_elimination naked_tuple_elimination_explain
+#define unique_elimination      unique_elimination_explain
+#define probe_value             probe_value_explain
+#define probe_elimination       probe_elimination_explain
+#include "sudoku_rules.h"
+#undef mark_cells
+#undef find_singletons
+#undef eliminate_singles
+#undef simple_solver
+#undef box_row_chute_elim
+#undef box_col_chute_elim
+#undef chute_elimination
+#undef elim_naked_tuples
+#undef naked_tuple_elimination
+#undef unique_elimination
+#undef probe_value
+#undef probe_elimination
+#endif
 
-	        g->pass_mods = 0;	/* Count number of solved cells per iteration */
+#undef EXPLAIN_HOOKS
+#define EXPLAIN_HOOKS 0
+#undef RULES_LAYOUT
+#define RULES_LAYOUT 1
+#define mark_cells              mark_cells_layout
+#define find_singletons         find_singletons_layout
+#define eliminate_singles       eliminate_singles_layout
+#define simple_solver           simple_solver_layout
+#define elim_naked_tuples       elim_naked_tuples_layout
+#define naked_tuple_elimination naked_tuple_elimination_layout
+#define probe_value             probe_value_layout
+#define probe_elimination       probe_elimination_layout
+#include "sudoku_rules.h"
+#undef mark_cells
+#undef find_singletons
+#undef eliminate_singles
+#undef simple_solver
+#undef elim_naked_tuples
+#undef naked_tuple_elimination
+#undef probe_value
+#undef probe_elimination
+#undef RULES_LAYOUT
+#undef EXPLAIN_HOOKS
+#ifdef EXPLAIN
+#define EXPLAIN_HOOKS 1
+#else
+#define EXPLAIN_HOOKS 0
+#endif
 
-        	if ((flag = mark_cells(g)) == IMPASSE) return flag;
+/*****************************************************************/
+/* The advanced deductive rules in their static order, with the  */
+/* grade each earns and its cost per call in passes of the       */
+/* simple solver. The adaptive schedule measures the costs as it */
+/* goes, and these only stand in until it has. RULE_UNIQUE       */
+/* assumes the puzzle has a unique solution, and RULE_PROBE is a */
+/* bounded form of trial; both are opt-in, and are never applied */
+/* when rating, so their grades are nominal.                     */
+/*****************************************************************/
 
-                rc |= flag;
+static const struct rule_info {
+        int rating;
+        unsigned int cost;
+} rules[NUM_RULES] = {
+	{ RATE_CHUTES, 1 },	/* chute_elimination()       */
+        { RATE_TUPLES, 4 },	/* naked_tuple_elimination() */
+        { RATE_TUPLES, 2 },	/* unique_elimination()      */
+        { RATE_TRIAL, 16 }	/* probe_elimination()       */
+};
 
-        	g->inc = 1;	     /* After initial markup, we start scoring for additional markup work */
+/*****************************************************************/
+/* The hot kernels of the solver: the simple solver and each of  */
+/* the advanced rules (in the order of the rules table), and the */
+/* checker of submitted solutions. On x86 they are also built    */
+/* for newer instruction sets, each variant with everything it   */
+/* calls (markup, singletons, subsets, etc.) flattened into it,  */
+/* and init_solve_engine() picks the best set that the CPU       */
+/* supports. Define NO_CPU_DISPATCH to build only the portable   */
+/* set. When explanations are asked for, it picks the explaining */
+/* set instead, which is portable only.                          */
+/*****************************************************************/
 
-        	if (flag == CHANGE) EXPLAIN_CURRENT_MARKUP(g);
+typedef struct kernels {
+	const char *name;
+        int (*simple)(Grid *g);
+        int (*rule[NUM_RULES])(Grid *g);
+        int (*check)(const char *puzzle, const char *answer, CHECK_RESULT *res);
+} Kernels;
 
-		/* Continue to eliminate cells with unique candidate solutions from the game until */
-        	/* elimination and repeated markup efforts produce no changes in the remaining     */
-	        /* candidate solutions.                                                            */
-                if (eliminate_singles(g) == NOCHANGE)
-			break;
+static const Kernels scalar_kernels = {
+	"scalar", simple_solver, { chute_elimination, naked_tuple_elimination, unique_elimination, probe_elimination },
+        check_submission
+};
 
-                /* score penalty for puzzle bottlenecks */
-		if (g->pass_mods < 4) {
-                        b = 1 + (20 * (PUZZLE_CELLS - g->exposed - g->pass_mods)) / (g->exposed * (g->pass_mods + 1));
-                        g->score += b;
-        	}
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_CPU_DISPATCH)
+#define CPU_DISPATCH
+
+#define KERNEL_VARIANT(sfx, isa)                                                                                        \
+static __attribute__((flatten, target(isa))) int simple_solver_##sfx(Grid *g) { return simple_solver(g); }              \
+static __attribute__((flatten, target(isa))) int chute_elimination_##sfx(Grid *g) { return chute_elimination(g); }      \
+static __attribute__((flatten, target(isa))) int naked_tuple_elimination_##sfx(Grid *g) { return naked_tuple_elimination(g); } \
+static __attribute__((flatten, target(isa))) int unique_elimination_##sfx(Grid *g) { return unique_elimination(g); }    \
+static __attribute__((flatten, target(isa))) int probe_elimination_##sfx(Grid *g) { return probe_elimination(g); }      \
+static __attribute__((flatten, target(isa))) int check_submission_##sfx(const char *p, const char *a, CHECK_RESULT *r)  \
+	{ return check_submission(p, a, r); }                                                                           \
+static const Kernels sfx##_kernels = {                                                                                  \
+	#sfx, simple_solver_##sfx,                                                                                      \
+        { chute_elimination_##sfx, naked_tuple_elimination_##sfx, unique_elimination_##sfx, probe_elimination_##sfx },  \
+        check_submission_##sfx                                                                                          \
+};
 
-                EXPLAIN_CURRENT_MARKUP(g);
-        }
+KERNEL_VARIANT(sse42, "popcnt,sse4.2")
+KERNEL_VARIANT(avx2, "popcnt,avx2,bmi,bmi2")
+KERNEL_VARIANT(avx512, "popcnt,avx2,bmi,bmi2,avx512f,avx512bw,avx512vl")
+#endif
 
-        /* score penalty for puzzle bottlenecks */
-	if (i == 0 && g->pass_mods < 4 && g->exposed < PUZZLE_CELLS) {
-                b = 1 + (20 * (PUZZLE_CELLS - g->exposed - g->pass_mods)) / (g->exposed * (g->pass_mods + 1));
-                g->score += b;
-        }
+#ifdef EXPLAIN
+/* The rules with their explanation hooks, and the checker, which has none */
+static const Kernels explain_kernels = {
+	"explain", simple_solver_explain,
+        { chute_elimination_explain, naked_tuple_elimination_explain, unique_elimination_explain, probe_elimination_explain },
+        check_submission
+};
+#endif
 
-        return rc;
+/* Stands in for a rule that does not hold in the layout */
+static int no_rule(Grid *g)
+{
+	return NOCHANGE;
 }
 
+/*****************************************************************/
+/* The rules over the tables of a variant layout. X-sudoku and   */
+/* windoku keep the classic boxes, so the classic chute rule     */
+/* holds for them, and only eliminates, leaving the markup of    */
+/* what it solves to the layout's own. Jigsaw boxes are not in   */
+/* bands, so no chute rule applies. Unique rectangles and BUG+1  */
+/* are not sound once there are extra units, and are left out.   */
+/*****************************************************************/
 
-/************************************************************************************/
-/* Test rows and columns of box arrays to see if the candidates for a particular    */
-/* number are confined to the same N rows or columns for the same set of N boxes,   */
-/* and if so, eliminate their occurences in the remainder of the rows and/or        */
-/* columns of the boxes not members of the aforementioned set of boxes.             */
-/* (Hint: Think pointing pairs, etc.)                                               */
-/*                                                                                  */
-/* The function has three possible return values:                                   */
-/*   NOCHANGE - Markup did not change during the last pass,                         */
-/*   CHANGE   - Markup was modified, and                                            */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values     */
-/************************************************************************************/
+static const Kernels layout_kernels = {
+	"layout", simple_solver_layout,
+        { chute_elimination, naked_tuple_elimination_layout, no_rule, probe_elimination_layout },
+        check_layout
+};
+
+static const Kernels jigsaw_kernels = {
+	"jigsaw", simple_solver_layout,
+        { no_rule, naked_tuple_elimination_layout, no_rule, probe_elimination_layout },
+        check_layout
+};
 
-static int box_row_chute_elim(Grid *g, int num)
+static const Kernels *kernel = &scalar_kernels;
+static const Kernels *plain_kernel = &scalar_kernels;	/* kernel, less any explanation hooks */
+
+/*****************************************************************/
+/* Build the units and peers of the layout chosen by set_layout. */
+/* Rows, columns and boxes come from the fixed tables, except    */
+/* that the regions of a jigsaw take the place of the boxes.     */
+/* A cell's peers are the other cells of its units, each once,   */
+/* in the order of the units, so those of the classic layout are */
+/* as in the fixed peers table.                                  */
+/*****************************************************************/
+
+static void build_layout(void)
 {
-        int i, j, k, b, c, mask, box_tuple, box_row_mask, t, rc;
-        short cell, boxmask[PUZZLE_DIM];
+	static const uint8_t corner[4] = { 10, 14, 46, 50 };	/* top left cells of the windows */
+	uint8_t in[PUZZLE_CELLS];
+        int u, i, j, c, d, n, len[PUZZLE_DIM];
+
+        layout.kind = layout_kind;
+        layout.units = 3 * PUZZLE_DIM;
+        layout.min_givens = layout_kind == LAYOUT_CLASSIC ? 17 : 8;	/* two digits missing could be swapped */
+        layout.extra_name = "Unit";
+        memcpy(layout.unit[0], row, sizeof(row));
+        memcpy(layout.unit[PUZZLE_DIM], col, sizeof(col));
+        memcpy(layout.unit[2 * PUZZLE_DIM], box, sizeof(box));
+
+        switch (layout_kind) {
+
+        case LAYOUT_X:
+        	for (i = 0; i < PUZZLE_DIM; i++) {
+                	layout.unit[layout.units][i] = i * (PUZZLE_DIM + 1);
+                        layout.unit[layout.units + 1][i] = (i + 1) * (PUZZLE_DIM - 1);
+                }
+                layout.units += 2;
+                layout.extra_name = "Diagonal";
+                break;
 
-        /* Init */
-        rc = NOCHANGE;
+        case LAYOUT_WINDOKU:
+        	for (u = 0; u < 4; u++, layout.units++) {
+                	for (i = 0; i < PUZZLE_DIM; i++) {
+                        	layout.unit[layout.units][i] = corner[u] + (i / PUZZLE_ORDER) * PUZZLE_DIM + i % PUZZLE_ORDER;
+                        }
+                }
+                layout.extra_name = "Window";
+                break;
 
-        mask = 1 << num;
+        case LAYOUT_JIGSAW:
+        	memset(len, 0, sizeof(len));
+                for (c = 0; c < PUZZLE_CELLS; c++) {
+                	u = layout_regions[c] - '1';
+                        layout.unit[2 * PUZZLE_DIM + u][len[u]++] = c;
+                }
+                break;
+        }
 
-	/* Compute the mask value for the box that has a 1 bit in       */
-        /* positions corresponding to the row containing the candidate. */
-        for (i = 0; i < PUZZLE_DIM; i++) {    /* for each box, do... */
-        	boxmask[i] = 0;
-        	for (j = 0; j < PUZZLE_DIM; j++) {	/* for each cell in the box do... */
-        		c = box[i][j];
-        		if ((g->cellflags[c] == UNSOLVED) && (g->cell[c] & mask)) {
-                        	boxmask[i] |= 1 << map[c].row;
-                	}
-        	}
+        for (c = 0; c < PUZZLE_CELLS; c++) {
+        	memset(in, 0, sizeof(in));
+                in[c] = 1;
+                for (n = u = 0; u < layout.units; u++) {
+                	for (i = 0; i < PUZZLE_DIM && layout.unit[u][i] != c; i++) ;
+                        if (i == PUZZLE_DIM) continue;
+                        for (j = 0; j < PUZZLE_DIM; j++) {
+                        	if (!in[d = layout.unit[u][j]]) {
+                                	in[d] = 1;
+                                        layout.peers[c][n++] = d;
+                                }
+                        }
+                }
+                layout.npeers[c] = n;
         }
+}
 
-	mask = ~mask;
+/* Choose the kernels for the layout, and for the classic layout, the best for the CPU or the explaining ones */
+static void select_kernels(void)
+{
+	if (layout.kind != LAYOUT_CLASSIC) {
+        	kernel = plain_kernel = layout.kind == LAYOUT_JIGSAW ? &jigsaw_kernels : &layout_kernels;
+                return;
+        }
+#ifdef CPU_DISPATCH
+	__builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("bmi2"))
+        	plain_kernel = &avx512_kernels;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        	plain_kernel = &avx2_kernels;
+        else if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        	plain_kernel = &sse42_kernels;
+        else
+#endif
+        	plain_kernel = &scalar_kernels;
 
-	/* Figure out, for each row of boxes, if the candidate number lies in N rows for a subset of N boxes */
-        /* where N is in the range [1..PUZZLE_ORDER-1].  If so, eliminate the candidate number from boxes    */
-        /* in that row of boxes which are not contained within the subset.                                   */
+        kernel = plain_kernel;
+#ifdef EXPLAIN
+	if (explain) kernel = &explain_kernels;
+#endif
+}
 
-        for (i = 1; i < PUZZLE_ORDER; i++) {					/* for each subset... */
+/* Tuning of the adaptive rule schedule */
+#define PAYOFF_WARMUP 32	/* calls before a rule's payoff is trusted    */
+#define PAYOFF_DECAY  256	/* halve the tallies at this many calls       */
+#define PAYOFF_PROBE  8		/* retry a rule skipped this many times       */
+#define PAYOFF_FLOOR  64	/* skip if hits/calls falls below cost/FLOOR  */
+#define PAYOFF_SAMPLE 8		/* time one call in this many                 */
 
-        	for (b = 0; b < PUZZLE_DIM; b += PUZZLE_ORDER) {		/* for each of the rows of boxes... */
+/* Running tally of a rule's payoff and cost, carried across puzzles */
+typedef struct payoff {
+	unsigned int calls, hits, idle;
+        unsigned int timed;	/* calls timed, and the ticks they took       */
+        uint64_t ticks;
+} Payoff;
 
-                	box_tuple = box_row_mask = 0;
+/*********************************************************************/
+/* Phases of a level on the trial-and-error stack, and the states of */
+/* a solver context.                                                 */
+/*********************************************************************/
 
-                	for (k = 0; k < PUZZLE_ORDER; k++) {			/* for each box within the row... */
+#define NODE_DEDUCE 0		/* apply the deductive rules to the level     */
+#define NODE_TRIAL  1		/* try the next candidate of the trial cell   */
+#define NODE_DONE   2		/* level exhausted, back out to the one above */
+
+#define CTX_IDLE    0		/* no puzzle loaded                           */
+#define CTX_START   1		/* puzzle loaded, search not yet started      */
+#define CTX_SEARCH  2		/* trial-and-error search in progress         */
+#define CTX_DONE    3		/* all solutions have been enumerated         */
+
+typedef struct frame {
+	Grid grid;		/* puzzle state at this level of trial-and-error */
+        short cell, mask;	/* trial cell, and its candidate last tried      */
+        short phase, flag;	/* phase of the level, and its result (SOLVED?)  */
+        short down;		/* try the candidates from 9 down to 1           */
+        short keyed;		/* level is to be recorded in the ttable         */
+        uint64_t key;		/* ttable key of the level's markup              */
+        unsigned int base;	/* solution count on entering the level          */
+        unsigned long work;	/* node count on entering the level              */
+} Frame;
 
-				if (bitcount(boxmask[b+k]) == i) {		/* does the box belong to the subset? */
+/*****************************************************************/
+/* A transposition table entry: the number of solutions below a  */
+/* markup state, and the number of nodes it took to count them.  */
+/*****************************************************************/
 
-                                	box_tuple = 1 << (b+k);			/* include box in subset */
-                                        box_row_mask = boxmask[b+k];
+typedef struct ttentry {
+	uint64_t key;
+        unsigned int count, work;
+} TTEntry;
+
+struct solver_ctx {
+	Frame stack[PUZZLE_CELLS+1];	/* one frame per level of trial-and-error */
+        int lvl;			/* current level, stack[lvl-1] is active  */
+        int state;			/* CTX_IDLE, CTX_START, etc.              */
+        int enumerate_all;		/* copied from engine setup at load time  */
+        int rating_mode;		/* skip pre-pass subsets when rating      */
+        int abort_mission;		/* set by the callback or a spent budget  */
+        RETURN_SOLN callback;		/* copied from engine setup at load time  */
+        int status;			/* SOLVE_OK, SOLVE_TIMEOUT, etc.          */
+        SOLVE_LIMITS limits;		/* budgets for each puzzle loaded         */
+        unsigned long nodes;		/* trial-and-error levels entered         */
+        unsigned long start;		/* time the search started, in msecs      */
+        unsigned long msecs;		/* time spent searching so far            */
+        int schedule;			/* SCHED_STATIC or SCHED_ADAPTIVE         */
+        int unique;			/* UNIQUE_OFF, UNIQUE_ASSUME, etc.        */
+        int probing;			/* probe bivalue cells before a trial     */
+        int refuted;			/* a plain search disagreed with unique   */
+        RULE_STATS rule[NUM_RULES];	/* rule counts for the loaded puzzle      */
+        Payoff payoff[NUM_RULES];	/* rule payoffs over the puzzles loaded   */
+        Payoff pass;			/* cost of the simple solver, likewise    */
+        Fault fault;			/* why the loaded puzzle failed, if it did */
+        int counting;			/* count solutions without returning them */
+        TTEntry *tt;			/* transposition table, pairs of entries  */
+        unsigned long tt_mask;		/* number of pairs in the table, less one */
+        unsigned long tt_hits;		/* subtrees counted from the table        */
+        int branch;			/* BRANCH_FIRST, BRANCH_LAST, etc.        */
+        uint32_t rand;			/* state of the tie breaker, never zero   */
+        volatile sig_atomic_t *race;	/* raised when a rival context finishes   */
+        struct solver_ctx *sub;		/* counts the parts of a split grid       */
+        const Kernels *kernels;		/* copied from engine setup at load time  */
+        int explain;			/* explain the search, ditto              */
+};
 
-                                	if (i - 1) for (t = 0; t < PUZZLE_ORDER; t++) {	/* find other boxes in the subset, if any */
+/*****************************************************************/
+/* Return a millisecond clock for timing the search. A monotonic */
+/* wall clock is used where the platform has one, otherwise we   */
+/* make do with processor time.                                  */
+/*****************************************************************/
 
-                                        	if (t != k && box_row_mask == boxmask[b+t]) {	/* did we find one? */
-                                                	box_tuple |= 1 << (b+t);
-                                                }
-                                        }
-                        	}
-                        }
+static unsigned long clock_msecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
 
-                        /* Did we meet N row and N box constraint for this row of boxes? */
-                        if (bitcount(box_tuple) == i) for (k = b; k < b+PUZZLE_ORDER; k++) {
-
-                        	if ((box_tuple & (1 << k)) == 0) {	/* If box k is not in subset... */
-
-                                	for (t = 0; t < PUZZLE_DIM; t++) {
-
-                                        	c = box[k][t];
-                                                cell = g->cell[c];
-
-                                                /* Is box cell in the desired row? */
-                                                /* And is it unsolved?             */
-                                                if (((1 << map[c].row) & box_row_mask) &&       
-                                                   g->cellflags[c] == UNSOLVED) {
-                                                	if ((g->cell[c] &= mask) == 0) {
-								EXPLAIN_VECTOR_IMPASSE(g, "row", box_row_mask, c, num, box_tuple);
-								g->score += 10;
-								return IMPASSE;
-                                                        }
-                                                        if (g->cell[c] ^ cell) {
-                                                                boxmask[k] &= ~(1 << map[c].row);
-                                                        	rc = CHANGE;
-                                                                g->pass_mods += 1;
-                                                                g->score += bitcount(g->cell[c] ^ cell);
-			                                        EXPLAIN_VECTOR_ELIM("row", box_row_mask, c, num, box_tuple);
-                                                                if (bitcount(g->cell[c]) == 1) {
-                                                                	g->cellflags[c] = SOLVED;
-                                                                        g->score += g->reward + 5;
-                                                                        g->solved[g->exposed++] = c;
-                                                                        EXPLAIN_VECTOR_SOLVE(g, c);
-                                                                        return CHANGE;
-                                                                }
-                                                        }
-                                                }
-                                        }
-                                }
-                        }
-                }
-        }
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        	return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+	return (unsigned long) ((double) clock() * 1000 / CLOCKS_PER_SEC);
+}
 
-        if (rc == CHANGE) {
-		g->score += 5;	/* Bump score for sucessfully invoking this rule */
-        }
+/* A finer clock for the cost of the rules: the cycle counter where there is one */
+static inline uint64_t clock_ticks(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_ia32_rdtsc();
+#else
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
 
-        return rc;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+	return clock();
+#endif
 }
 
-/*************/
-/* As above. */
-/*************/
+/* Flags raised by another thread, such as the cancel token, without a data race */
+#if defined(__GNUC__)
+#define FLAG_RAISED(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define RAISE_FLAG(p)       __atomic_store_n((p), 1, __ATOMIC_RELAXED)
+#else
+#define FLAG_RAISED(p)      (*(p))
+#define RAISE_FLAG(p)       (*(p) = 1)
+#endif
 
-static int box_col_chute_elim(Grid *g, int num)
-{
-        int i, j, k, b, c, mask, box_tuple, box_col_mask, t, rc;
-        short cell, boxmask[PUZZLE_DIM];
+/*****************************************************************/
+/* Count a node of the search and check it against the budgets.  */
+/* The clock is only read every 64 nodes to keep this cheap. If  */
+/* the search must stop, the status is recorded and the abort    */
+/* flag is raised so that the stack unwinds as for the callback. */
+/*****************************************************************/
 
-        /* Init */
-        rc = NOCHANGE;
+static int out_of_budget(SOLVER_CTX *ctx)
+{
+	SOLVE_LIMITS *lim = &ctx->limits;
+        const Grid *g = &ctx->stack[ctx->lvl-1].grid;
+
+        ctx->nodes += 1;
+
+        if ((lim->cancel && FLAG_RAISED(lim->cancel)) || (ctx->race && FLAG_RAISED(ctx->race)))
+        	ctx->status = SOLVE_CANCELLED;
+        else if (lim->max_nodes && ctx->nodes > lim->max_nodes)
+        	ctx->status = SOLVE_TIMEOUT;
+        else if (lim->max_msecs && !(ctx->nodes & 63) && clock_msecs() - ctx->start >= lim->max_msecs)
+        	ctx->status = SOLVE_TIMEOUT;
+        else if (!ctx->counting && !g->solncount &&
+                 ((lim->max_score && g->score > lim->max_score) || (lim->max_depth && g->maxlvl > lim->max_depth)))
+        	ctx->status = SOLVE_TOOHARD;
+        else
+        	return 0;
+
+        ctx->abort_mission = 1;
+        return 1;
+}
 
-        mask = 1 << num;
+/*****************************************************************/
+/* Adaptive rule scheduling. A rule is worth its keep while it   */
+/* changes the markup at least once in every PAYOFF_FLOOR/cost   */
+/* calls. Otherwise it is skipped, but still probed now and then */
+/* in case the puzzles at hand have changed character. The cost  */
+/* of a call is measured in passes of the simple solver, timing  */
+/* one call in PAYOFF_SAMPLE of each, so that the schedule holds */
+/* on any CPU and kernel set. The tallies age together.          */
+/*****************************************************************/
 
-	/* Compute the mask value for the box that has a 1 bit in          */
-        /* positions corresponding to the column containing the candidate. */
-        for (i = 0; i < PUZZLE_DIM; i++) {    /* for each box, do... */
-        	boxmask[i] = 0;
-        	for (j = 0; j < PUZZLE_DIM; j++) {	/* for each cell in the box do... */
-        		c = box[i][j];
-        		if ((g->cellflags[c] == UNSOLVED) && (g->cell[c] & mask)) {
-                        	boxmask[i] |= 1 << map[c].col;
-                	}
-        	}
+static void age_payoff(Payoff *p)
+{
+	if (p->calls >= PAYOFF_DECAY) {
+        	p->calls /= 2;
+                p->hits /= 2;
+                p->timed /= 2;
+                p->ticks /= 2;
         }
+}
 
-	mask = ~mask;
-
-	/* Figure out, for each column of boxes, if the candidate number lies in N columns for a subset of N boxes */
-        /* where N is in the range [1..PUZZLE_ORDER-1].  If so, eliminate the candidate number from boxes          */
-        /* in those column of boxes which are not contained within the subset.                                     */
+/* Run the simple solver, timing it now and then for the adaptive schedule */
+static inline int simple_pass(SOLVER_CTX *ctx, Grid *g)
+{
+	Payoff *p = &ctx->pass;
+        uint64_t t0;
+        int flag;
 
-        for (i = 1; i < PUZZLE_ORDER; i++) {					/* for each subset... */
+        if (ctx->schedule != SCHED_ADAPTIVE || ++p->calls % PAYOFF_SAMPLE) return ctx->kernels->simple(g);
 
-        	for (b = 0; b < PUZZLE_ORDER; b++) {				/* for each of the columns of boxes... */
+        t0 = clock_ticks();
+        flag = ctx->kernels->simple(g);
+        p->ticks += clock_ticks() - t0;
+        p->timed += 1;
+        age_payoff(p);
 
-                	box_tuple = box_col_mask = 0;
+        return flag;
+}
 
-                	for (k = 0; k < PUZZLE_DIM; k += PUZZLE_ORDER) {	/* for each box within the column... */
+/* The cost of a call of a rule, as measured, or from the rules table until it has been */
+static double rule_cost(const SOLVER_CTX *ctx, int r)
+{
+	const Payoff *p = &ctx->payoff[r], *s = &ctx->pass;
 
-				if (bitcount(boxmask[b+k]) == i) {		/* does the box belong to the subset? */
+        if (!p->timed || !s->timed || !s->ticks) return rules[r].cost;
 
-                                	box_tuple = 1 << (b+k);			/* include box in subset */
-                                        box_col_mask = boxmask[b+k];
+        return ((double) p->ticks / p->timed) / ((double) s->ticks / s->timed);
+}
 
-                                	if (i - 1) for (t = 0; t < PUZZLE_DIM; t += PUZZLE_ORDER) { /* find other boxes in the subset, if any */
+static int skip_rule(SOLVER_CTX *ctx, int r)
+{
+	Payoff *p = &ctx->payoff[r];
 
-                                        	if (t != k && box_col_mask == boxmask[b+t]) {	/* did we find one? */
-                                                	box_tuple |= 1 << (b+t);
-                                                }
-                                        }
-                        	}
-                        }
+        if (ctx->schedule != SCHED_ADAPTIVE || p->calls < PAYOFF_WARMUP) return 0;
 
-                        /* Did we meet N column and N box constraint for this column of boxes? */
-                        if (bitcount(box_tuple) == i) for (k = b; k < PUZZLE_DIM; k += PUZZLE_ORDER) {
-
-                        	if ((box_tuple & (1 << k)) == 0) {	/* If box k is not in subset... */
-
-                                	for (t = 0; t < PUZZLE_DIM; t++) {
-
-                                        	c = box[k][t];
-                                                cell = g->cell[c];
-
-                                                /* Is box cell in the desired column? */
-                                                /* And is it unsolved?                */
-                                                if (((1 << map[c].col) & box_col_mask) &&       
-                                                   g->cellflags[c] == UNSOLVED) {
-                                                	if ((g->cell[c] &= mask) == 0) {
-								EXPLAIN_VECTOR_IMPASSE(g, "column", box_col_mask, c, num, box_tuple);
-								g->score += 10;
-								return IMPASSE;
-                                                        }
-                                                        if (g->cell[c] ^ cell) {
-                                                                boxmask[k] &= ~(1 << map[c].col);
-                                                        	rc = CHANGE;
-                                                                g->pass_mods += 1;
-                                                                g->score += bitcount(g->cell[c] ^ cell);
-			                                        EXPLAIN_VECTOR_ELIM("column", box_col_mask, c, num, box_tuple);
-                                                                if (bitcount(g->cell[c]) == 1) {
-                                                                	g->cellflags[c] = SOLVED;
-                                                                        g->score += g->reward + 5;
-                                                                        g->solved[g->exposed++] = c;
-                                                                        EXPLAIN_VECTOR_SOLVE(g, c);
-                                                                        return CHANGE;
-                                                                }
-                                                        }
-                                                }
-                                        }
-                                }
-                        }
-                }
-        }
+        if (p->hits * PAYOFF_FLOOR >= p->calls * rule_cost(ctx, r)) return 0;
 
-        if (rc == CHANGE) {
-		g->score += 5;	/* Bump score for sucessfully invoking this rule */
+        if (++p->idle >= PAYOFF_PROBE) {
+        	p->idle = 0;
+                return 0;
         }
 
-        return rc;
+        ctx->rule[r].skips += 1;
+        return 1;
 }
 
-/**********************************************************************************/
-/* Test all boxes to see if the possibilities for a number                        */
-/* are confined to specific row or column chutes, and if so, eliminate            */
-/* the occurence of candidate solutions from the remainder of the                 */
-/* specified row or column.                                                       */
-/*                                                                                */
-/* The function has three possible return values:                                 */
-/*   NOCHANGE - Markup did not change during the last pass,                       */
-/*   CHANGE   - Markup was modified, and                                          */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
-/**********************************************************************************/
-
-static int chute_elimination(Grid *g)
+/* Apply a rule, keeping the books on it */
+static int apply_rule(SOLVER_CTX *ctx, Grid *g, int r)
 {
-	int i, rc;
-
-        rc = NOCHANGE;
-        g->pass_mods = 0;
+	Payoff *p = &ctx->payoff[r];
+        uint64_t t0;
+	int flag;
+
+        if (ctx->schedule == SCHED_ADAPTIVE && p->calls % PAYOFF_SAMPLE == 0) {
+        	t0 = clock_ticks();
+                flag = ctx->kernels->rule[r](g);
+                p->ticks += clock_ticks() - t0;
+                p->timed += 1;
+        }
+        else flag = ctx->kernels->rule[r](g);
 
-	/* For each digit... */
-	for (i = 0; i < PUZZLE_DIM && rc == NOCHANGE; i++) {
-		rc |= box_row_chute_elim(g, i);
-        }        
+        ctx->rule[r].calls += 1;
+        p->calls += 1;
 
-	if (rc == NOCHANGE) for (i = 0; i < PUZZLE_DIM && rc == NOCHANGE; i++) {
-		rc |= box_col_chute_elim(g, i);
+        if (flag == CHANGE) {
+        	ctx->rule[r].hits += 1;
+                p->hits += 1;
+                bump_rating(g, rules[r].rating);
         }
 
-        /* score penalty for puzzle bottlenecks */
-	if (g->pass_mods && g->pass_mods < 3) {
-                g->score += 15 - (5 * g->pass_mods);;
-        }
+        /* Age the tallies so that they follow the current puzzles */
+        age_payoff(p);
 
-        return rc;
+        return flag;
 }
 
+/*****************************************************************/
+/* Apply the advanced rules until one of them changes the markup */
+/* or finds an impasse. The adaptive schedule tries the rule     */
+/* with the better payoff per unit of cost first. The opt-in     */
+/* rules always come last, in the order of the rules table.      */
+/*****************************************************************/
 
-/**********************************************************************************/
-/* This function implements the rule that when a subset of cells                  */
-/* in a row/column/box contain matching tuples of candidate                       */
-/* solutions, i.e. 2 matching candidates for 2 cells, 3 matching                  */
-/* candidate possibilities for 3 cells, etc., then those                          */
-/* candidate tuples may be eliminated from the other cells in the                 */
-/* row, column, or box.                                                           */
-/*                                                                                */
-/* The function has three possible return values:                                 */
-/*   NOCHANGE - Markup did not change during the last pass,                       */
-/*   CHANGE   - Markup was modified, and                                          */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
-/**********************************************************************************/
-
-static int elim_naked_tuples(Grid *g, int const *cell_list, char *desc, int ndx)
+static int advanced_rules(SOLVER_CTX *ctx, Grid *g)
 {
-	int i, j, k, c, rc, flag, tuple_count, cellset, iter;
-	const int *tuple_list;
-        short m, mask, totalmask, tmp;
+	Payoff *c = &ctx->payoff[RULE_CHUTES], *t = &ctx->payoff[RULE_TUPLES];
+	int i, r, flag = NOCHANGE, first = RULE_CHUTES;
 
-        rc = NOCHANGE;
+        if (ctx->schedule == SCHED_ADAPTIVE && c->calls >= PAYOFF_WARMUP && t->calls >= PAYOFF_WARMUP &&
+            (double) t->hits * c->calls * rule_cost(ctx, RULE_CHUTES) > (double) c->hits * t->calls * rule_cost(ctx, RULE_TUPLES))
+        	first = RULE_TUPLES;
 
-	/* Compute bitmap of all possible candidates for this list of unsolved cells. */
-        for (j = totalmask = 0; j < PUZZLE_DIM; j++) {
-        	if (g->cellflags[cell_list[j]] == UNSOLVED)
-                	totalmask |= g->cell[cell_list[j]];
-        }
-
-        iter = bitcount(totalmask);
+        for (i = 0; i < RULE_UNIQUE; i++) {
+        	r = (first + i) % RULE_UNIQUE;
 
-        /* Check for two thru N valued naked tuples */
-        for (i = 2; i < iter; i++) {
+                if (skip_rule(ctx, r)) continue;
 
-        	flag = NOCHANGE;
-                tuple_list = tuples_list[i].tuple_list;
-                tuple_count = tuples_list[i].tuple_count;
+                flag = apply_rule(ctx, g, r);
+                if (flag == CHANGE || flag == IMPASSE || g->exposed >= PUZZLE_CELLS) return flag;
+        }
 
-                for (j = 0; j < tuple_count && i < iter; j++) {
+        /* Assume a unique solution, if asked to, before falling back on trial-and-error */
+        if (ctx->unique && !skip_rule(ctx, RULE_UNIQUE)) {
+        	flag = apply_rule(ctx, g, RULE_UNIQUE);
+                if (flag == CHANGE || flag == IMPASSE || g->exposed >= PUZZLE_CELLS) return flag;
+        }
 
-                	mask = tuple_list[j];
+        /* And probe bivalue cells, if asked to, as a last resort short of a new level */
+        if (ctx->probing && !skip_rule(ctx, RULE_PROBE))
+        	flag = apply_rule(ctx, g, RULE_PROBE);
 
-                	/* prune tuple search space */
-                	if ((mask & totalmask) != mask) continue;
+        return flag;
+}
+
+/*****************************************************************/
+/* Track the current level of trial-and-error. The explanation   */
+/* routines indent by the level of the search being explained.   */
+/*****************************************************************/
+
+static inline void set_level(SOLVER_CTX *ctx, int level)
+{
+	ctx->lvl = level;
+#ifdef EXPLAIN
+	if (ctx->explain) lvl = level;
+#endif
+}
+
+/*****************************************************************/
+/* Note a solution found at the active level and hand it to the  */
+/* user supplied callback.                                       */
+/*****************************************************************/
+
+static void found_soln(SOLVER_CTX *ctx, Grid *g)
+{
+        g->solncount += 1;
+        if (ctx->counting) return;
+        ctx->abort_mission = ctx->callback(g);
+        if (ctx->explain) EXPLAIN_SOLN_FOUND(g);
+}
+
+/*****************************************************************/
+/* Transposition table for counting solutions. Once a level has  */
+/* been marked up, the digits of its solved cells are struck     */
+/* from all their peers, so the number of solutions below it     */
+/* depends only on the markup of the cells still unsolved.       */
+/* Levels that differ only in how other parts of the grid were   */
+/* filled in, which are common in sparse puzzles, are therefore  */
+/* the same state. When counting, the count below each level is  */
+/* kept in a table keyed by a Zobrist hash of that markup.       */
+/* Entries come in pairs; a new entry evicts the one of the pair */
+/* that cost fewer nodes to count. Keys are 64 bits and are not  */
+/* verified against the full markup, so a collision, while most  */
+/* unlikely, would go unnoticed.                                 */
+/*****************************************************************/
+
+static uint64_t zobrist[PUZZLE_CELLS][PUZZLE_DIM];
+
+/* Fill the Zobrist keys from a fixed seed (splitmix64) */
+static void init_zobrist(void)
+{
+	uint64_t x = 0x5ad0c0de, z;
+        int i, j;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	for (j = 0; j < PUZZLE_DIM; j++) {
+                	z = (x += 0x9e3779b97f4a7c15ULL);
+                        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                        zobrist[i][j] = z ^ (z >> 31);
+                }
+        }
+}
+
+static uint64_t markup_key(const Grid *g)
+{
+	uint64_t key = 0;
+        int i, j, m;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (IS_SOLVED(g, i)) continue;
+        	for (m = g->cell[i], j = 0; m; m >>= 1, j++) {
+                	if (m & 1) key ^= zobrist[i][j];
+                }
+        }
+
+        return key ? key : 1;	/* zero marks an empty entry */
+}
+
+/* Look up the level about to branch. On a hit, its count is taken from the table. */
+static int tt_probe(SOLVER_CTX *ctx, Frame *f)
+{
+	TTEntry *e;
+
+        f->key = markup_key(&f->grid);
+        e = &ctx->tt[2 * (f->key & ctx->tt_mask)];
+
+        if (e[0].key == f->key || e[1].key == f->key) {
+        	f->grid.solncount += e[e[0].key == f->key ? 0 : 1].count;
+                ctx->tt_hits += 1;
+                return 1;
+        }
+
+        f->keyed = 1;
+        f->base = f->grid.solncount;
+        f->work = ctx->nodes;
+        return 0;
+}
+
+/* Record the count below a level as it is backed out of */
+static void tt_store(SOLVER_CTX *ctx, const Frame *f)
+{
+	TTEntry *e = &ctx->tt[2 * (f->key & ctx->tt_mask)];
+        unsigned long work = ctx->nodes - f->work;
 
-			/* Look for all unsolved cells containing this tuple */
-                        for (m = 1, cellset = k = 0; k < PUZZLE_DIM; m <<= 1, k++) {
-	                	c = cell_list[k];
-        	                if (g->cellflags[c] == UNSOLVED && (g->cell[c] & mask) == g->cell[c])
-                                	cellset |= m;
+        if (e[0].key != f->key && (e[1].key == f->key || e[1].work < e[0].work)) e += 1;
+
+        e->key = f->key;
+        e->count = f->grid.solncount - f->base;
+        e->work = work > UINT_MAX ? UINT_MAX : work;
+}
+
+/*****************************************************************/
+/* Branching heuristics. Every heuristic branches on a cell with */
+/* the fewest candidates, and takes any cell with two at once;   */
+/* they differ in which of the tied cells they take, and in the  */
+/* order its candidates are tried. Searches that branch in       */
+/* different orders can take very different times on the same   */
+/* puzzle, which the portfolio solver makes use of.              */
+/*****************************************************************/
+
+/* Tie breaker (xorshift32), kept per context so threads do not share it */
+static inline uint32_t branch_rand(SOLVER_CTX *ctx)
+{
+	uint32_t x = ctx->rand;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        return ctx->rand = x;
+}
+
+/* Return the cell to branch on, or -1, and its number of candidates in *alts */
+static int trial_cell(SOLVER_CTX *ctx, const Grid *g, int *alts)
+{
+	int i, j, min, c, ties;
+
+        switch (ctx->branch) {
+
+        case BRANCH_LAST:
+        	for (c = -1, j = 0, min = PUZZLE_DIM, i = PUZZLE_CELLS-1; i >= 0; i--) {
+                	if (!IS_SOLVED(g, i)) {
+                        	j = bitcount(g->cell[i]);
+                                if (j < min) {
+                                	min = j;
+                                        c = i;
+                                        if (j == 2) break;	/* bifurcate now */
+                                }
                         }
+                }
+                break;
 
-			/* Did we find a naked tuple? */
-                        if ((m = bitcount(cellset)) == i) {
+        case BRANCH_RANDOM:
+        	/* Every cell with the fewest candidates is equally likely to be taken */
+        	for (c = -1, min = PUZZLE_DIM, ties = 0, i = 0; i < PUZZLE_CELLS; i++) {
+                	if (!IS_SOLVED(g, i)) {
+                        	j = bitcount(g->cell[i]);
+                                if (j < min) {
+                                	min = j;
+                                        c = i;
+                                        ties = 1;
+                                }
+                                else if (j == min && branch_rand(ctx) % ++ties == 0) {
+                                	c = i;
+                                }
+                        }
+                }
+                j = min;
+                break;
 
-                                mask = ~mask;
-                                totalmask &= mask;
-                                iter = bitcount(totalmask);
+        default:
+        	/* Find the first cell with the smallest number of alternatives */
+        	for (c = -1, j = 0, min = PUZZLE_DIM, i = 0; i < PUZZLE_CELLS; i++) {
+                	if (!IS_SOLVED(g, i)) {
+                        	j = bitcount(g->cell[i]);
+                                if (j < min) {
+                                	min = j;
+                                        c = i;
+                                        if (j == 2) break;	/* bifurcate now */
+                                }
+                        }
+                }
+                break;
+        }
 
-                                for (m = 1, k = 0; k < PUZZLE_DIM; k++, m <<= 1) {
+        *alts = j;
+        return c;
+}
 
-        		                if (m & cellset) continue;	/* skip cells within tuple set */
+/*****************************************************************/
+/* Component decomposition, for counting. Once a level has been  */
+/* marked up, two unsolved cells constrain one another only if   */
+/* they share a unit and a candidate. When the unsolved cells    */
+/* fall into groups with no such link between them, which is     */
+/* common in sparse puzzles, any solution of one group goes with */
+/* any solution of the others. The count below the level is then */
+/* the product of the groups' counts, and their choices need not */
+/* be searched in every combination.                             */
+/*                                                               */
+/* Each group is counted in a context of its own, on a copy of   */
+/* the level with the other groups filled in from one solution   */
+/* of the whole. So the rules, the transposition table (which is */
+/* shared) and further splits all apply within the group. The    */
+/* groups are counted one after another; they are mostly small,  */
+/* and counting them in parallel would mean locking the table.   */
+/*****************************************************************/
 
-		                	c = cell_list[k];
-					if (g->cellflags[c] != UNSOLVED) continue;	/* only consider unsolved cells */
+#define NO_GROUP 0xff
 
-                                        /* Get cell candidates */
-                                        tmp = g->cell[c];
+static int default_callback(const Grid *g);
 
-                                        /* Eliminate tuple values from cell candidates */
-                                        g->cell[c] &= mask;
+/* Label the groups of unsolved cells, in the order of their first cells, and return how many there are */
+static int components(const Grid *g, uint8_t *group)
+{
+	uint32_t left[GRID_MAP_WORDS];
+        uint8_t stack[PUZZLE_CELLS];
+        const uint8_t *q;
+        int i, c, p, n, sp;
+
+        for (i = 0; i < GRID_MAP_WORDS; i++) left[i] = ~g->solvedmap[i];
+        memset(group, NO_GROUP, PUZZLE_CELLS);
+
+        /* Flood each group from its first cell, through peers with a candidate in common */
+        for (n = i = 0; i < PUZZLE_CELLS; i++) {
+        	if (!(left[i >> 5] & MAP_BIT(i))) continue;
+
+        	left[i >> 5] &= ~MAP_BIT(i);
+                group[i] = n;
+                stack[0] = i;
+                for (sp = 1; sp; ) {
+                	c = stack[--sp];
+                        for (q = layout.peers[c]; q < layout.peers[c] + layout.npeers[c]; q++) {
+                        	p = *q;
+                                if ((left[p >> 5] & MAP_BIT(p)) && (g->cell[p] & g->cell[c])) {
+                                	left[p >> 5] &= ~MAP_BIT(p);
+                                        group[p] = n;
+                                        stack[sp++] = p;
+                                }
+                        }
+                }
+                n++;
+        }
+
+        return n;
+}
+
+/* Set a context up to search below a copy of a level of another */
+static void load_part(SOLVER_CTX *sub, SOLVER_CTX *ctx, const Grid *g, int counting)
+{
+	Frame *f = &sub->stack[0];
+
+        memcpy(&f->grid, g, sizeof(Grid));
+        f->grid.solncount = 0;
+        f->phase = NODE_DEDUCE;
+        f->flag = IMPASSE;
+        f->keyed = 0;
+
+        sub->lvl = 1;
+        sub->state = CTX_SEARCH;
+        sub->status = SOLVE_OK;
+        sub->abort_mission = 0;
+        sub->counting = sub->enumerate_all = counting;
+        sub->callback = default_callback;
+        sub->rating_mode = 0;
+        sub->unique = UNIQUE_OFF;
+        sub->refuted = 0;
+        sub->schedule = ctx->schedule;
+        sub->probing = ctx->probing;
+        sub->branch = ctx->branch;
+        sub->limits = ctx->limits;
+        sub->limits.max_score = sub->limits.max_depth = 0;	/* a count has no score */
+        sub->race = ctx->race;
+        sub->kernels = ctx->kernels;
+        sub->explain = ctx->explain;
+        sub->nodes = ctx->nodes;		/* budgets run on from the parent's */
+        sub->start = ctx->start;
+        sub->tt = ctx->tt;
+        sub->tt_mask = ctx->tt_mask;
+        sub->tt_hits = 0;
+        memset(sub->rule, 0, sizeof(sub->rule));
+        memcpy(sub->payoff, ctx->payoff, sizeof(ctx->payoff));
+        sub->pass = ctx->pass;
+}
+
+/* Take back the work done in a part. Returns zero if it ran out of budget. */
+static int absorb_part(SOLVER_CTX *ctx, const SOLVER_CTX *sub)
+{
+	int r;
+
+        ctx->nodes = sub->nodes;
+        ctx->tt_hits += sub->tt_hits;
+        memcpy(ctx->payoff, sub->payoff, sizeof(ctx->payoff));
+        ctx->pass = sub->pass;
+        for (r = 0; r < NUM_RULES; r++) {
+        	ctx->rule[r].calls += sub->rule[r].calls;
+                ctx->rule[r].hits += sub->rule[r].hits;
+                ctx->rule[r].skips += sub->rule[r].skips;
+        }
+
+        if (sub->abort_mission) {
+        	ctx->status = sub->status;
+                ctx->abort_mission = 1;
+                return 0;
+        }
+
+        return 1;
+}
+
+/* Count the level about to branch by its groups, if it falls apart. Returns zero if it does not. */
+static int split_count(SOLVER_CTX *ctx, Frame *f)
+{
+	uint8_t group[PUZZLE_CELLS];
+        Grid *g = &f->grid, soln, *t;
+        const Grid *s;
+        SOLVER_CTX *sub;
+        unsigned int count = 0, product;
+        int i, k, n, cells;
+
+        if ((n = components(g, group)) < 2) return 0;
+
+        if ((sub = ctx->sub) == NULL) sub = ctx->sub = solver_create();
+
+        /* One solution of the whole, to fill in the other groups with */
+        load_part(sub, ctx, g, 0);
+        s = solver_next(sub);
+        if (!absorb_part(ctx, sub)) return 1;
+        if (s == NULL) {
+        	f->flag = IMPASSE;
+                return 1;
+        }
+        memcpy(&soln, s, sizeof(Grid));
+
+        for (product = 1, k = 0; k < n && product; k++) {
+
+        	/* A cell linked to no other has as many solutions as candidates */
+        	for (cells = 0, i = 0; i < PUZZLE_CELLS; i++) {
+                	if (group[i] == k && cells++ == 0) count = bitcount(g->cell[i]);
+                }
+                if (cells == 1) {
+                	product *= count;
+                        continue;
+                }
+
+        	load_part(sub, ctx, g, 1);
+                t = &sub->stack[0].grid;
+                for (i = 0; i < PUZZLE_CELLS; i++) {
+                	if (group[i] == NO_GROUP || group[i] == k) continue;
+                        t->cell[i] = soln.cell[i];
+                        MARK_SOLVED(t, i);
+                        t->solved[t->exposed++] = i;
+                }
+
+                while (solver_next(sub) != NULL)
+                	;
+                if (!absorb_part(ctx, sub)) return 1;
+
+                product *= t->solncount;
+        }
+
+        g->solncount += product;
+        f->flag = product ? SOLVED : IMPASSE;
+
+        return 1;
+}
+
+/*****************************************************************/
+/* Trial-and-error solver. Rather than recursing, each level of  */
+/* trial-and-error is a frame on the explicit stack held in the  */
+/* solver context, so the C stack stays flat however deep the    */
+/* search goes. The search returns whenever a solution is found  */
+/* and picks up where it left off when called again. A NULL      */
+/* return indicates that the search is exhausted.                */
+/*****************************************************************/
+
+static const Grid *rsolve(SOLVER_CTX *ctx)
+{
+	int j, c, mask, flag;
+        Frame *f, *child;
+        Grid *g;
+
+        for (;;) {
+
+        	f = &ctx->stack[ctx->lvl-1];
+                g = &f->grid;
+
+                switch (f->phase) {
+
+                case NODE_DEDUCE:
+
+                	f->phase = NODE_DONE;
 
-                                        /* Did the elimination change the candidates? */
-                                        if (tmp ^ g->cell[c]) {
+                        if (!ctx->abort_mission) out_of_budget(ctx);
 
-                                                /* Note the change and bump the score */
-						flag = CHANGE;
-                                                g->pass_mods += 1;
-		                                g->score += bitcount(tmp ^ g->cell[c]);
+		        /* Attempt a simple solution */
+		        while (!ctx->abort_mission && simple_pass(ctx, g) != IMPASSE && g->exposed < PUZZLE_CELLS) {
 
-                                                EXPLAIN_TUPLE_ELIM(desc, ndx, ~mask, c);
+		                /* Eliminate clues aligned along chutes within boxes from */
+				/* cells exterior to the box that are in those chutes,    */
+		                /* and eliminate tuples                                   */
+		                if ((flag = advanced_rules(ctx, g)) == CHANGE) {
+					if (ctx->explain) EXPLAIN_CURRENT_MARKUP(g);
+					continue;
+				}
 
-                                                /* Did we solve the cell under consideration? */
-                        	        	if (bitcount(g->cell[c]) == 1) {
+		                /* Check if impasse or solution */
+		                if (flag == IMPASSE || g->exposed >= PUZZLE_CELLS) break;
 
-                                                	/* Mark cell as found and bump the score */
-                                        		g->cellflags[c] = SOLVED;
-                		                        g->score += g->reward;
-                                                        g->solved[g->exposed++] = c;
-                                                        EXPLAIN_TUPLE_SOLVE(g, c);
-	        	                        }
-        	                        }
+		                g->reward = ctx->lvl * 10;	/* Bump reward as we are about to start trial-and-error soutions */
+
+				/* Find a cell with the smallest number of alternatives */
+		                c = trial_cell(ctx, g, &j);
+
+		                /* Cell at index 'c' will be our starting point */
+		                if (c >= 0) {
+			                if (j) g->score += (PUZZLE_CELLS - g->exposed) * 5 * j * (1+ctx->lvl) * (1+ctx->lvl);	/* Add penalty to score */
+                                        f->cell = c;
+                                        f->mask = 0;
+                                        f->phase = NODE_TRIAL;
+                                        f->down = ctx->branch == BRANCH_LAST || (ctx->branch == BRANCH_RANDOM && (branch_rand(ctx) & 1));
+
+                                        /* When counting, a markup seen before need not be searched again, */
+                                        /* nor the choices of independent groups of cells combined          */
+                                        if (ctx->counting && ctx->tt && tt_probe(ctx, f)) f->phase = NODE_DONE;
+                                        else if (ctx->counting && split_count(ctx, f)) f->phase = NODE_DONE;
+                                }
+
+		                break;
+		        }
+
+                        /* Did we find a solution? If so, hand it back, and back out when called again */
+		        if (f->phase == NODE_DONE && !ctx->abort_mission && g->exposed == PUZZLE_CELLS && validate(g, NULL, NULL)) {
+                        	f->flag = SOLVED;
+                                found_soln(ctx, g);
+                                if (!ctx->counting) return g;
+                        }
+                        break;
+
+                case NODE_TRIAL:
+
+                	/* Get next possible candidate */
+                        if (f->down) {
+	                        for (mask = f->mask ? f->mask >> 1 : 1 << (PUZZLE_DIM-1); mask; mask >>= 1) {
+	                        	if (mask & g->cell[f->cell]) break;
+	                        }
+                        }
+                        else {
+	                        for (mask = f->mask ? f->mask << 1 : 1; mask < (1 << PUZZLE_DIM); mask <<= 1) {
+	                        	if (mask & g->cell[f->cell]) break;
+	                        }
+                                if (mask >= (1 << PUZZLE_DIM)) mask = 0;
+                        }
+
+                        if (!mask) {
+                        	f->phase = NODE_DONE;
+                                break;
+                        }
+
+                        f->mask = mask;
+                        c = f->cell;
+
+                        if (ctx->explain) EXPLAIN_TRIAL(c, mask);
+
+                        /* Try one of the possible candidates for this cell in a working copy of the puzzle */
+                        child = f + 1;
+                        memcpy(&child->grid, g, sizeof(Grid));
+                        child->grid.cell[c] = mask;
+                        MARK_SOLVED(&child->grid, c);
+                        child->grid.solved[child->grid.exposed++] = c;
+                        bump_rating(&child->grid, RATE_TRIAL + ctx->lvl - 1);
+                        child->phase = NODE_DEDUCE;
+                        child->flag = IMPASSE;
+                        child->keyed = 0;
+
+			if (ctx->explain) EXPLAIN_CURRENT_MARKUP(&child->grid);
+
+                        /* Descend, keeping track of the depth */
+                        set_level(ctx, ctx->lvl + 1);
+                        if (ctx->lvl > child->grid.maxlvl) child->grid.maxlvl = ctx->lvl;
+                        break;
+
+                case NODE_DONE:
+
+                	if (!ctx->abort_mission && ctx->explain) EXPLAIN_BACKTRACK;
+
+                        if (f->keyed && !ctx->abort_mission) tt_store(ctx, f);
+
+                        flag = f->flag;
+                        set_level(ctx, ctx->lvl - 1);
+
+                        /* Back at the top? Then the search is exhausted */
+                        if (ctx->lvl == 0) {
+                        	ctx->state = CTX_DONE;
+				if (flag != SOLVED && !g->solncount && !ctx->abort_mission) {
+                                	ctx->status = SOLVE_NOSOLUTION;
+	                                validate(g, NULL, &ctx->fault);	/* Note where the puzzle fails */
                                 }
+                                return NULL;
+                        }
+
+                        /* Preserve score, solution count and recursive depth as we back out */
+                        f -= 1;
+                        f->grid.score = g->score;
+                        f->grid.solncount = g->solncount;
+                        f->grid.maxlvl = g->maxlvl;
+
+                        if (flag == SOLVED && !ctx->enumerate_all) {
+                        	f->flag = SOLVED;
+                                f->phase = NODE_DONE;
+                        }
+                        else if (ctx->abort_mission) {
+                        	f->phase = NODE_DONE;
                         }
-			else if (m > i) {
-                		EXPLAIN_TUPLE_IMPASSE(g, desc, ndx, cellset, m, i);
-                        	g->score += 10;
-				return IMPASSE;
-                	}
+                        break;
                 }
-                
-                if (flag == CHANGE)
-			g->score += 10 + 2 *(5 - abs(5 - i));
+        }
+}
 
-                rc |= flag;
+/*****************************************************************/
+/* This function adds a puzzle solution to a singly linked list  */
+/* of solutions. It dies if no memory is available.              */
+/*****************************************************************/
+static inline void add_grid(Solution **soln_list, const Grid *g)
+{
+	Solution *tmp;
+
+	if ((tmp = malloc(sizeof(Solution))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	memcpy(&tmp->grid, g, sizeof(Grid));
+	tmp->next = *soln_list;
+	*soln_list = tmp;
+}
+
+/*************************************************/
+/* Return the next solution of the loaded puzzle */
+/*************************************************/
+
+static const Grid *next_soln(SOLVER_CTX *ctx)
+{
+	Grid *g = &ctx->stack[0].grid;
+	int flag = NOCHANGE;
+
+        switch (ctx->state) {
+
+        case CTX_START:
+
+        	ctx->state = CTX_DONE;
+                ctx->start = clock_msecs();
+
+	        if (ctx->kernels->simple(g) != IMPASSE && g->exposed < PUZZLE_CELLS) {
+
+			/* It is beneficial to eliminate subsets once before recursion, but this is *expensive*,  */
+	                /* so we keep it pushed to the back of the rule set in rsolve(). When rating a puzzle we */
+	                /* skip it altogether, otherwise subsets would be charged ahead of the cheaper rules.    */
+			if (!ctx->rating_mode && !skip_rule(ctx, RULE_TUPLES))
+	                	flag = apply_rule(ctx, g, RULE_TUPLES);
+
+	        	if (flag != IMPASSE && g->exposed < PUZZLE_CELLS) {
+
+				/* Non-trivial puzzle, start trial-and-error solver */
+	                        ctx->stack[0].phase = NODE_DEDUCE;
+	                        ctx->stack[0].flag = IMPASSE;
+	                        ctx->stack[0].keyed = 0;
+	                        set_level(ctx, 1);
+	                        ctx->state = CTX_SEARCH;
+	                        return rsolve(ctx);
+	                }
+	        }
+
+	        if (g->exposed == PUZZLE_CELLS && validate(g, NULL, NULL)) {
+	                found_soln(ctx, g);
+	                return g;
+	        }
+
+	        ctx->status = SOLVE_NOSOLUTION;
+	        validate(g, NULL, &ctx->fault);	/* Note where the puzzle fails */
+                return NULL;
+
+        case CTX_SEARCH:
+        	return rsolve(ctx);
+
+        default:
+        	return NULL;
         }
+}
 
-	return rc;
+const Grid *solver_next(SOLVER_CTX *ctx)
+{
+	const Grid *g;
+
+        if (ctx->state != CTX_START && ctx->state != CTX_SEARCH) return NULL;
+
+        g = next_soln(ctx);
+        ctx->msecs = clock_msecs() - ctx->start;
+
+        return g;
 }
 
+/********************************************************/
+/* Load a puzzle into a solver context, ready to search */
+/********************************************************/
 
-/**********************************************************************************/
-/* Eliminate subsets from rows, columns, and boxes.                               */
-/*                                                                                */
-/* The function has three possible return values:                                 */
-/*   NOCHANGE - Markup did not change during the last pass,                       */
-/*   CHANGE   - Markup was modified, and                                          */
-/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
-/**********************************************************************************/
- 
-static int naked_tuple_elimination(Grid *g)
+int solver_load(SOLVER_CTX *ctx, const char *puzzle)
 {
-	int i, rc = NOCHANGE;
+	Grid *g = &ctx->stack[0].grid;
+
+        ctx->state = CTX_IDLE;
+        ctx->nodes = ctx->start = ctx->msecs = 0;
+        memset(ctx->rule, 0, sizeof(ctx->rule));
+        clear_fault(&ctx->fault);
+        ctx->counting = 0;
+        ctx->tt_hits = 0;
+
+	if (cvt_to_grid(g, puzzle) != PUZZLE_CELLS) {	/* bogus puzzle */
+        	ctx->status = SOLVE_BADFORMAT;
+		return 0;
+        }
 
-        g->pass_mods = 0;
+        if (g->givens < layout.min_givens) {
+        	ctx->status = SOLVE_FEWGIVENS;
+	        return 0;            /* Bogus puzzle */
+	}
 
-        /* Eliminate subsets from rows */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	rc |= elim_naked_tuples(g, row[i], "row", i);
+        EXPLAIN_GRID(g);
+
+        set_level(ctx, 0);
+        ctx->abort_mission = 0;
+        ctx->status = SOLVE_OK;
+        ctx->enumerate_all = enumerate_all;
+        ctx->callback = soln_callback;
+        ctx->rating_mode = 0;
+        ctx->schedule = rule_schedule;
+        ctx->unique = uniqueness;
+        ctx->probing = probing;
+        ctx->refuted = 0;
+        ctx->kernels = kernel;
+        ctx->explain = explain;
+        ctx->state = CTX_START;
+
+        /* A digit given twice in a unit is insoluble on the face of it */
+        if (!check_givens(g, &ctx->fault)) {
+        	ctx->status = SOLVE_CONTRADICTION;
+                ctx->state = CTX_DONE;
         }
 
-        /* Eliminate subsets from columns */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	rc |= elim_naked_tuples(g, col[i], "column", i);
+        return 1;
+}
+
+/**************************************************************/
+/* Return the root grid of the loaded puzzle. Once the search */
+/* is exhausted without a solution, this is the partially     */
+/* completed grid.                                            */
+/**************************************************************/
+
+const Grid *solver_grid(const SOLVER_CTX *ctx)
+{
+	return &ctx->stack[0].grid;
+}
+
+/********************************/
+/* CTOR and DTOR for a context. */
+/********************************/
+
+SOLVER_CTX *solver_create(void)
+{
+	SOLVER_CTX *ctx;
+
+        if (!initialized) {
+		fprintf(stderr, "solve engine not properly initialized\n");
+	        exit(1);
         }
 
-        /* Eliminate subsets from boxes */
-        for (i = 0; i < PUZZLE_DIM; i++) {
-        	rc |= elim_naked_tuples(g, box[i], "box", i);
+	if ((ctx = malloc(sizeof(SOLVER_CTX))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+        ctx->state = CTX_IDLE;
+        ctx->limits = limits;
+        ctx->status = SOLVE_OK;
+        ctx->nodes = ctx->start = ctx->msecs = 0;
+        ctx->schedule = rule_schedule;
+        ctx->unique = uniqueness;
+        ctx->probing = probing;
+        ctx->refuted = 0;
+        memset(ctx->rule, 0, sizeof(ctx->rule));
+        memset(ctx->payoff, 0, sizeof(ctx->payoff));
+        memset(&ctx->pass, 0, sizeof(ctx->pass));
+        clear_fault(&ctx->fault);
+        ctx->counting = 0;
+        ctx->tt = NULL;
+        ctx->tt_mask = ctx->tt_hits = 0;
+        ctx->branch = BRANCH_FIRST;
+        ctx->rand = 1;
+        ctx->race = NULL;
+        ctx->kernels = kernel;
+        ctx->explain = explain;
+        ctx->sub = NULL;
+
+        return ctx;
+}
+
+void solver_destroy(SOLVER_CTX *ctx)
+{
+	if (ctx->sub) {
+        	ctx->sub->tt = NULL;		/* the table is the parent's */
+                solver_destroy(ctx->sub);
+        }
+	free(ctx->tt);
+	free(ctx);
+}
+
+/*****************************************************************/
+/* Size the transposition table of a context used for counting.  */
+/* The table is kept across puzzles, as the counts it holds do   */
+/* not depend on the puzzle they were found in.                  */
+/*****************************************************************/
+
+void solver_ttable(SOLVER_CTX *ctx, size_t max_bytes)
+{
+	unsigned long pairs = 1;
+
+        free(ctx->tt);
+        ctx->tt = NULL;
+        ctx->tt_mask = 0;
+
+        if (max_bytes < 2 * sizeof(TTEntry)) return;
+
+        while (pairs * 2 <= max_bytes / (2 * sizeof(TTEntry))) pairs *= 2;
+
+	if ((ctx->tt = calloc(2 * pairs, sizeof(TTEntry))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+        ctx->tt_mask = pairs - 1;
+}
+
+/*****************************************************************/
+/* Count the solutions of the loaded puzzle without handing them */
+/* back one by one, using the transposition table if there is    */
+/* one. The solution callback is not called.                     */
+/*****************************************************************/
+
+unsigned int solver_count(SOLVER_CTX *ctx)
+{
+	if (ctx->state != CTX_START) return 0;
+
+        ctx->counting = 1;
+        ctx->enumerate_all = 1;
+        ctx->unique = UNIQUE_OFF;	/* a count may not assume the answer */
+
+        while (solver_next(ctx) != NULL)
+        	;
+
+        ctx->counting = 0;
+
+        return ctx->stack[0].grid.solncount;
+}
+
+/*****************************************************/
+/* Set the search budgets of a context, NULL for none */
+/*****************************************************/
+
+void solver_limits(SOLVER_CTX *ctx, const SOLVE_LIMITS *lim)
+{
+	if (lim) ctx->limits = *lim;
+        else memset(&ctx->limits, 0, sizeof(SOLVE_LIMITS));
+}
+
+/*****************************************************************/
+/* Set the branching heuristic of a context, and seed its tie    */
+/* breaker (for BRANCH_RANDOM.)                                  */
+/*****************************************************************/
+
+void solver_branching(SOLVER_CTX *ctx, int heuristic, unsigned long seed)
+{
+	ctx->branch = heuristic;
+        ctx->rand = (uint32_t) (seed * 2654435761u) | 1;	/* xorshift must not start at zero */
+}
+
+/**************************************************************/
+/* Report the statistics of the puzzle loaded into a context. */
+/**************************************************************/
+
+void solver_stats(const SOLVER_CTX *ctx, SOLVE_STATS *st)
+{
+	const Grid *g = &ctx->stack[0].grid;
+
+        memset(st, 0, sizeof(SOLVE_STATS));
+        st->status = ctx->status;
+        st->unit_type = ctx->fault.unit_type;
+        st->unit = ctx->fault.unit;
+        st->cell = ctx->fault.cell;
+        if (ctx->state == CTX_IDLE) return;
+
+        st->nodes = ctx->nodes;
+        st->msecs = ctx->msecs;
+        st->solncount = g->solncount;
+        st->score = g->score;
+        st->maxlvl = g->maxlvl;
+        memcpy(st->rule, ctx->rule, sizeof(st->rule));
+        st->tt_hits = ctx->tt_hits;
+        st->refuted = ctx->refuted;
+}
+
+/*****************************************************************/
+/* Explain why the puzzle loaded into a context failed. This is  */
+/* only done on request, as the status and fault in the stats    */
+/* are enough for most callers.                                  */
+/*****************************************************************/
+
+void solver_diagnose(const SOLVER_CTX *ctx, FILE *h)
+{
+	const Grid *g = &ctx->stack[0].grid;
+        const Fault *f = &ctx->fault;
+
+        if (h == NULL) h = rejects;
+
+        switch (ctx->status) {
+
+        case SOLVE_BADFORMAT:
+        	fprintf(h, "Puzzle is shorter than %d cells.\n", PUZZLE_CELLS);
+                break;
+
+        case SOLVE_FEWGIVENS:
+        	fprintf(h, "Puzzle has %d givens, at least %d are needed.\n", g->givens, layout.min_givens);
+                break;
+
+        case SOLVE_CONTRADICTION:
+        	fprintf(h, "%s %d has more than one %c given, at row %d, col %d.\n", unit_name(f->unit_type), 1+f->unit,
+                	symtab[g->cell[f->cell]], 1+map[f->cell].row, 1+map[f->cell].col);
+                break;
+
+        case SOLVE_NOSOLUTION:
+        	validate(g, h, NULL);
+                break;
+        }
+}
+
+/*****************************************************************/
+/* Interactive sessions. A session holds a puzzle in play: its   */
+/* givens, the digits placed by the player, and the markup that  */
+/* follows from them. The markup is kept up to date as the       */
+/* puzzle is edited, touching only the peers of the edited cell, */
+/* and it is never solved ahead of the player. Hints are found   */
+/* by running the deductive rules on a copy of it.               */
+/*****************************************************************/
+
+struct solver_session {
+	Grid grid;			/* the puzzle in play                     */
+        SOLVER_CTX *ctx;		/* for hints needing trial-and-error      */
+};
+
+/* Strike the digit of solved cell c from the markup of its unsolved peers */
+static void session_mark(Grid *g, int c)
+{
+	int i, ndx;
+
+        for (i = 0; i < layout.npeers[c]; i++) {
+        	ndx = layout.peers[c][i];
+                if (!IS_SOLVED(g, ndx)) g->cell[ndx] &= ~g->cell[c];
+        }
+}
+
+/* Recompute the markup of unsolved cell c from its solved peers */
+static void session_remark(Grid *g, int c)
+{
+	int i, ndx, mask = 0x01ff;
+
+        for (i = 0; i < layout.npeers[c]; i++) {
+        	ndx = layout.peers[c][i];
+                if (IS_SOLVED(g, ndx)) mask &= ~g->cell[ndx];
+        }
+        g->cell[c] = mask;
+}
+
+/* Does a digit clash with a solved peer of cell c? */
+static int session_clash(const Grid *g, int c, int mask)
+{
+	int i, ndx;
+
+        for (i = 0; i < layout.npeers[c]; i++) {
+        	ndx = layout.peers[c][i];
+                if (IS_SOLVED(g, ndx) && g->cell[ndx] == mask) return 1;
+        }
+        return 0;
+}
+
+/* Take cell c out of play, and restore the markup of it and its peers */
+static void session_unsolve(Grid *g, int c)
+{
+	int i, j;
+
+        CLEAR_SOLVED(g, c);
+        if (IS_GIVEN(g, c)) {
+        	CLEAR_GIVEN(g, c);
+                g->givens -= 1;
+        }
+
+        for (i = j = 0; i < g->exposed; i++) {
+        	if (g->solved[i] != c) g->solved[j++] = g->solved[i];
+        }
+        g->exposed = g->tail = j;
+
+        session_remark(g, c);
+        for (i = 0; i < layout.npeers[c]; i++) {
+        	if (!IS_SOLVED(g, layout.peers[c][i])) session_remark(g, layout.peers[c][i]);
+        }
+}
+
+/* Put a digit into play at cell c */
+static int session_solve(Grid *g, int c, int digit, int given)
+{
+	int mask;
+
+        if (c < 0 || c >= PUZZLE_CELLS || digit < 1 || digit > PUZZLE_DIM) return SOLVE_BADFORMAT;
+
+        mask = 1 << (digit - 1);
+
+        if (IS_SOLVED(g, c)) {
+        	if (IS_GIVEN(g, c) && !given) return SOLVE_BADFORMAT;	/* players may not overwrite givens */
+                session_unsolve(g, c);
+        }
+
+        if (session_clash(g, c, mask)) return SOLVE_CONTRADICTION;
+
+        g->cell[c] = mask;
+        if (given) {
+        	MARK_GIVEN(g, c);
+                g->givens += 1;
+        }
+        else MARK_SOLVED(g, c);
+        g->solved[g->exposed++] = c;
+        g->tail = g->exposed;
+
+        session_mark(g, c);
+
+        return SOLVE_OK;
+}
+
+/* Mark a puzzle up from its givens alone, with no deductions made */
+static int session_markup(Grid *g, const char *puzzle)
+{
+	int i, rc;
+
+        init_grid(g);
+
+        for (i = 0; i < PUZZLE_CELLS && puzzle[i]; i++) {
+        	if (is_given(puzzle[i]) && (rc = session_solve(g, i, puzzle[i] - '0', 1)) != SOLVE_OK) {
+                	return rc;
+                }
         }
 
-        /* score penalty for puzzle bottlenecks */
-	if (g->pass_mods && g->pass_mods < 4) {
-                g->score += 20 - (5 * g->pass_mods);;
-        }
+        return i == PUZZLE_CELLS ? SOLVE_OK : SOLVE_BADFORMAT;
+}
 
-        return rc;
+int session_load(SOLVER_SESSION *s, const char *puzzle)
+{
+	return session_markup(&s->grid, puzzle);
 }
 
-/**************************************************/
-/* Entry point to the recursive solver algorithm. */
-/**************************************************/
-static int rsolve(Grid *g)
+int session_place(SOLVER_SESSION *s, int cell, int digit)
 {
-	int i, j, min, c, mask, flag = NOCHANGE;
-        Grid mygrid;
+	return session_solve(&s->grid, cell, digit, 0);
+}
 
-        /* Keep track of recursive depth */
-        lvl += 1;
-        if (lvl > g->maxlvl) g->maxlvl = lvl;
+int session_add_given(SOLVER_SESSION *s, int cell, int digit)
+{
+	return session_solve(&s->grid, cell, digit, 1);
+}
 
-        /* Attempt a simple solution */
-        while (simple_solver(g) != IMPASSE && g->exposed < PUZZLE_CELLS) {
+int session_clear(SOLVER_SESSION *s, int cell)
+{
+	Grid *g = &s->grid;
 
-                /* Eliminate clues aligned along chutes within boxes from */
-		/* cells exterior to the box that are in those chutes     */
-                if ((flag = chute_elimination(g)) == CHANGE) {
-			EXPLAIN_CURRENT_MARKUP(g);
-			continue;
-		}
+	if (cell < 0 || cell >= PUZZLE_CELLS || IS_GIVEN(g, cell)) return SOLVE_BADFORMAT;
 
-                /* Check if impasse or solution */
-                if (flag == IMPASSE || g->exposed >= PUZZLE_CELLS) break;
+        if (IS_SOLVED(g, cell)) session_unsolve(g, cell);
 
-		/* Eliminate tuples */
-                if ((flag = naked_tuple_elimination(g)) == CHANGE) {
-			EXPLAIN_CURRENT_MARKUP(g);
-			continue;
-		}
+        return SOLVE_OK;
+}
 
-                /* Check if impasse or solution */
-                if (flag == IMPASSE || g->exposed >= PUZZLE_CELLS) break;
+int session_remove_given(SOLVER_SESSION *s, int cell)
+{
+	Grid *g = &s->grid;
 
-                g->reward = lvl * 10;		/* Bump reward as we are about to start trial-and-error soutions */
+	if (cell < 0 || cell >= PUZZLE_CELLS || !IS_GIVEN(g, cell)) return SOLVE_BADFORMAT;
 
-                /* Attempt a trial solution */
-        	memcpy(&mygrid, g, sizeof(Grid));	/* Make working copy of puzzle */
+        session_unsolve(g, cell);
 
-		/* Find the first cell with the smallest number of alternatives */
-        	for (c = -1, j = 0, min = PUZZLE_DIM, i = 0; i < PUZZLE_CELLS; i++) {
-        		if (mygrid.cellflags[i] == UNSOLVED) {
-				j = bitcount(mygrid.cell[i]);
-        	                if (j < min) {
-					min = j;
-                        	        c = i;
-                                        if (j == 2) break;	/* bifurcate now */
-	                        }
-        	        }
-	        }
+        return SOLVE_OK;
+}
 
-                if (j) mygrid.score += (PUZZLE_CELLS - mygrid.exposed) * 5 * j * (1+lvl) * (1+lvl);	/* Add penalty to score */
-
-                /* Cell at index 'c' will be our starting point */
-        	if (c >= 0) for (mask = 1, i = 0; i < PUZZLE_DIM; i++) {
-
-                	/* Is this a candidate? */
-        		if (mask & g->cell[c]) {
-
-                        	EXPLAIN_TRIAL(c, mask);
-
-                                /* Try one of the possible candidates for this cell */
-        	        	mygrid.cell[c] = mask;
-                	        mygrid.cellflags[c] = SOLVED;
-                                mygrid.solved[mygrid.exposed++] = c;
-
-				EXPLAIN_CURRENT_MARKUP(&mygrid);
-	                        flag = rsolve(&mygrid);		/* Recurse with working copy of puzzle */
-
-                                /* Preserve score, solution count and recursive depth as we back out of recursion */
-                                g->score = mygrid.score;
-                                g->solncount = mygrid.solncount;
-                                g->maxlvl = mygrid.maxlvl;
-                	        memcpy(&mygrid, g, sizeof(Grid));
-
-                                /* Did we find a solution? */
-                        	if (flag == SOLVED) {
-					if (!enumerate_all) {
-                                		EXPLAIN_BACKTRACK;
-                                        	lvl -= 1;
-                                        	return SOLVED;
-                                        }
-        	                }
-                                else if (abort_mission) {
-                                       	lvl -= 1;
-                                       	return IMPASSE;
-                                }
+/*****************************************************************/
+/* Set a context up to search for a first solution from a grid   */
+/* already marked up, as load_part() does for a part. Hints and  */
+/* clue analysis use it. It runs on the plain kernels, so no     */
+/* explanations are printed, and, as neither may assume a unique */
+/* solution, without the uniqueness rules.                       */
+/*****************************************************************/
 
-	                }
-        		mask <<= 1;	/* Get next possible candidate */
-	        }
+static void load_grid(SOLVER_CTX *ctx, const Grid *g)
+{
+	Frame *f = &ctx->stack[0];
+
+        memcpy(&f->grid, g, sizeof(Grid));
+        f->grid.solncount = 0;
+
+        ctx->nodes = ctx->start = ctx->msecs = 0;
+        memset(ctx->rule, 0, sizeof(ctx->rule));
+        clear_fault(&ctx->fault);
+        ctx->tt_hits = 0;
+
+        set_level(ctx, 0);
+        ctx->abort_mission = 0;
+        ctx->status = SOLVE_OK;
+        ctx->counting = ctx->enumerate_all = 0;
+        ctx->callback = default_callback;
+        ctx->rating_mode = 0;
+        ctx->schedule = rule_schedule;
+        ctx->unique = UNIQUE_OFF;
+        ctx->probing = probing;
+        ctx->refuted = 0;
+        ctx->kernels = plain_kernel;
+        ctx->explain = 0;
+        ctx->state = CTX_START;
+}
 
-                break;
+/*****************************************************************/
+/* Find the next step for the player. Naked singles are read off */
+/* the markup. Otherwise the deductive rules are applied to a    */
+/* copy of the puzzle, in the same order as the solver, until a  */
+/* cell is solved, and the hardest rule needed is reported. If   */
+/* the rules run dry, the puzzle is solved by trial-and-error    */
+/* and the cell the solver would branch on is revealed.          */
+/*****************************************************************/
+
+int session_hint(SOLVER_SESSION *s, HINT *h)
+{
+	Grid *g = &s->grid, scratch;
+        const Grid *soln;
+        int i, r, c, bc, min, flag;
+
+        h->cell = -1;
+        h->digit = 0;
+        h->rating = RATE_GIVENS;
+
+        if (g->exposed == PUZZLE_CELLS) return SOLVE_OK;
+        if (g->exposed == 0) return SOLVE_FEWGIVENS;
+
+        /* Naked singles, and cells with no candidates left */
+        for (c = -1, min = PUZZLE_DIM + 1, i = 0; i < PUZZLE_CELLS; i++) {
+        	if (IS_SOLVED(g, i)) continue;
+                if ((bc = bitcount(g->cell[i])) == 0) return SOLVE_NOSOLUTION;
+                if (bc < min) {
+                	min = bc;
+                        c = i;
+                }
+        }
+
+        if (min == 1) {
+        	h->cell = c;
+                h->digit = symtab[g->cell[c]] - '0';
+                h->rating = RATE_SINGLES;
+                return SOLVE_OK;
         }
 
-        if (abort_mission) {
-        	lvl -= 1;
-		return IMPASSE;
+        /* Work through the rules on a copy, treating the player's digits as givens */
+        memcpy(&scratch, g, sizeof(Grid));
+        scratch.givens = scratch.exposed;
+        scratch.rating = RATE_GIVENS;
+
+        while ((flag = plain_kernel->simple(&scratch)) != IMPASSE) {
+		if (scratch.exposed > g->exposed) {
+                	h->cell = scratch.solved[g->exposed];
+                        h->digit = symtab[scratch.cell[h->cell]] - '0';
+                        h->rating = scratch.rating;
+                        return SOLVE_OK;
+                }
+
+                for (r = 0; r < RULE_UNIQUE; r++) {	/* hints may not assume a unique solution */
+                	if ((flag = plain_kernel->rule[r](&scratch)) == CHANGE) bump_rating(&scratch, rules[r].rating);
+                        if (flag != NOCHANGE) break;
+                }
+                if (flag != CHANGE) break;
         }
 
-        if (g->exposed == PUZZLE_CELLS && validate(g, 0)) {
-                add_soln(g);
-	        EXPLAIN_SOLN_FOUND(g);
-                EXPLAIN_BACKTRACK;
-                lvl -= 1;
-		flag = SOLVED;
-        } else {
-	        EXPLAIN_BACKTRACK;
-		lvl -= 1;
-		flag = IMPASSE;
+        if (flag == IMPASSE) return SOLVE_NOSOLUTION;
 
+        /* No deduction to be had: look the answer up for the branch cell, from what the rules left */
+        if (s->ctx == NULL) s->ctx = solver_create();
 
+        load_grid(s->ctx, &scratch);
 
-                if (!lvl && !g->solncount) validate(g, 1);		/* Print verbose diagnostic for insoluble puzzle */
-        }
+        if ((soln = solver_next(s->ctx)) == NULL) return s->ctx->status;
+
+        h->cell = c;
+        h->digit = symtab[soln->cell[c]] - '0';
+        h->rating = RATE_TRIAL;
 
-	return flag;
+        return SOLVE_OK;
 }
 
-/*****************************************************************/
-/* This function adds a puzzle solution to a singly linked list  */
-/* of solutions. It dies if no memory is available.              */
-/*****************************************************************/
-static inline void add_grid(const Grid *g)
+const Grid *session_grid(const SOLVER_SESSION *s)
 {
-	Grid *tmp;
+	return &s->grid;
+}
+
+/********************************************/
+/* CTOR and DTOR for an interactive session */
+/********************************************/
 
-	if ((tmp = malloc(sizeof(Grid))) == NULL) {
+SOLVER_SESSION *session_create(void)
+{
+	SOLVER_SESSION *s;
+
+	if ((s = malloc(sizeof(SOLVER_SESSION))) == NULL) {
 		fprintf(stderr, "Out of memory.\n");
 		exit(1);
 	}
-	memcpy(tmp, g, sizeof(Grid));
-	tmp->next = soln_list;
-	soln_list = tmp;
+        init_grid(&s->grid);
+        s->ctx = NULL;
+
+        return s;
 }
 
-static int add_soln(Grid *g)
+void session_destroy(SOLVER_SESSION *s)
 {
-        g->solncount += 1;
-	add_grid(g);
-        abort_mission = soln_callback(g);
-        return 0;
+	if (s->ctx) solver_destroy(s->ctx);
+	free(s);
 }
 
+/*****************************************************************/
+/* Check submitted solutions against their puzzles, see the      */
+/* header. Short strings are rejected before the kernel, which   */
+/* reads all 81 characters of both.                              */
+/*****************************************************************/
 
-/****************************************/
-/* Entry point to the solver algorithm. */
-/****************************************/
-
-static inline int solve_grid(Grid *g)
+int check_solution(const char *puzzle, const char *answer, CHECK_RESULT *res)
 {
-	int flag = NOCHANGE;
+	int i;
 
-        if (simple_solver(g) != IMPASSE && g->exposed < PUZZLE_CELLS) {
+        res->unit_type = UNIT_NONE;
+        res->unit = res->cell = -1;
 
-	        flag = naked_tuple_elimination(g);		/* It is beneficial to eliminate subsets once before recursion, */
-                						/* but this is *expensive*, so we keep it pushed to the back    */
-                                                                /* of the rule set in rsolve()                                  */
+        /* The first cell that is not a digit, if only the end of the answer */
+        if (memchr(answer, 0, PUZZLE_CELLS) != NULL) {
+        	for (i = 0; answer[i] >= '1' && answer[i] <= '9'; i++);
+                res->cell = i;
+                return res->status = CHECK_BADFORMAT;
+        }
+        if (memchr(puzzle, 0, PUZZLE_CELLS) != NULL) return res->status = CHECK_BADFORMAT;
 
-        	if (flag != IMPASSE && g->exposed < PUZZLE_CELLS) {
+        return kernel->check(puzzle, answer, res);
+}
 
-			/* Non-trivial puzzle, call recursive solver */
-                        return rsolve(g);
-                }
-        }
+size_t check_solutions(const char * const *puzzles, const char * const *answers, size_t n, CHECK_RESULT *res)
+{
+	size_t i, valid = 0;
 
-        if (g->exposed == PUZZLE_CELLS && validate(g, 0)) {
-                add_soln(g);
-	        EXPLAIN_SOLN_FOUND(g);
-		flag = SOLVED;
-        } else {
-		flag = IMPASSE;
-                validate(g, 1);		/* Print verbose diagnostic for insoluble puzzle */
+        for (i = 0; i < n; i++) {
+        	if (check_solution(puzzles[i], answers[i], &res[i]) == CHECK_OK) valid++;
         }
 
-	return flag;
+        return valid;
 }
 
 /*************************************************/
 /* DTOR for list returned from the solver engine */
 /*************************************************/
 
-void free_soln_list(Grid *soln_list)
+void free_soln_list(Solution *soln_list)
 {
-	Grid *s;
+	Solution *s;
 
 	/* Clean out old solutions, if any */
 	for (s = soln_list; s;) {
@@ -1877,8 +3141,8 @@ void free_soln_list(Grid *soln_list)
 /* Sudoku puzzle solver engine entry point.                      */
 /*                                                               */
 /* Solve the supplied 81 character puzzle, if solvable. Return a */
-/* list of grids which enumerate all possible solutions. If no   */
-/* solution exists, the list will contain a single partially     */
+/* list of solutions which enumerate all possible solutions. If  */
+/* no solution exists, the list will contain a single partially  */
 /* completed grid, and the solncount member will be set to zero. */
 /* Note that only the first 81 characters of the supplied puzzle */
 /* argument string are examined; any excess is ignored. The      */
@@ -1888,46 +3152,219 @@ void free_soln_list(Grid *soln_list)
 /*****************************************************************/
 
 
-static Grid *_solve_sudoku(const char *puzzle)
+static int default_callback(const Grid *g)
+{
+	return 0;
+}
+
+static SOLVER_CTX *engine_ctx = NULL;	/* context behind solve_sudoku() */
+static SOLVER_CTX *verify_ctx = NULL;	/* plain search for UNIQUE_VERIFY */
+static SOLVER_CTX *last_ctx = NULL;	/* context of the last puzzle solved */
+
+/* Enumerate the solutions of the puzzle loaded into a context */
+static Solution *collect_solns(SOLVER_CTX *ctx)
 {
-        Grid g;
+        Solution *soln_list = NULL;
+        const Grid *g;
+
+        /* Solve the puzzle, if possible */
+        while ((g = solver_next(ctx)) != NULL) {
+        	add_grid(&soln_list, g);
+        }
 
-        abort_mission = 0;
+        g = solver_grid(ctx);
 
-	if (cvt_to_grid(&g, puzzle) != PUZZLE_CELLS) {	/* bogus puzzle */
-		return NULL;
+        if (g->solncount == 0) {
+		add_grid(&soln_list, g);	/* add unsolved grid - solncount == 0 indicates puzzle is unsolvable */
         }
 
-        if (g.givens < 17) {
-	        return NULL;            /* Bogus puzzle */
-	}
+        return soln_list;
+}
+
+/* Check that two lists hold the same number of solutions, and the same first one */
+static int same_solns(const Solution *s1, const Solution *s2)
+{
+	int n1, n2;
+        const Solution *s;
 
-        EXPLAIN_GRID(&g);
+        for (n1 = 0, s = s1; s; s = s->next) n1 += s->grid.solncount != 0;
+        for (n2 = 0, s = s2; s; s = s->next) n2 += s->grid.solncount != 0;
 
-	soln_list = NULL;
+        if (n1 != n2) return 0;
+        if (n1 == 0) return 1;
 
-        /* Solve the puzzle, if possible */
-        solve_grid(&g);
+        while (s1->next) s1 = s1->next;		/* lists are in reverse order of finding */
+        while (s2->next) s2 = s2->next;
+
+        return memcmp(s1->grid.cell, s2->grid.cell, sizeof(s1->grid.cell)) == 0;
+}
+
+/*****************************************************************/
+/* Search the puzzle again without the deductions that assume a  */
+/* unique solution. If the two searches disagree, the puzzle is  */
+/* not unique and the plain search is the answer. The plain      */
+/* search is neither explained nor handed to the callback.       */
+/*****************************************************************/
+
+static Solution *verify_unique(const char *puzzle, Solution *soln_list)
+{
+	Solution *plain;
+#ifdef EXPLAIN
+	int saved = explain;
+
+        explain = 0;
+#endif
+
+        if (verify_ctx == NULL) verify_ctx = solver_create();
+        verify_ctx->limits = limits;
+
+        solver_load(verify_ctx, puzzle);
+        verify_ctx->unique = UNIQUE_OFF;
+        verify_ctx->callback = default_callback;
+        plain = collect_solns(verify_ctx);
+
+#ifdef EXPLAIN
+	explain = saved;
+#endif
+
+        if (verify_ctx->status != SOLVE_OK && verify_ctx->status != SOLVE_NOSOLUTION) {
+        	free_soln_list(plain);		/* out of budget, so no verdict */
+        }
+        else if (same_solns(soln_list, plain)) {
+        	free_soln_list(plain);
+        }
+        else {
+        	free_soln_list(soln_list);
+                soln_list = plain;
+                verify_ctx->refuted = 1;
+                last_ctx = verify_ctx;
+        }
 
-        if (g.solncount == 0) {
-		add_grid(&g);	/* add unsolved grid - solncount == 0 indicates puzzle is unsolvable */
+        return soln_list;
+}
+
+static Solution *_solve_sudoku(const char *puzzle, int rating)
+{
+	SOLVER_CTX *ctx;
+        Solution *soln_list;
+
+        if (engine_ctx == NULL) engine_ctx = solver_create();
+        ctx = last_ctx = engine_ctx;
+        ctx->limits = limits;
+
+        if (!solver_load(ctx, puzzle)) {
+        	return NULL;
+        }
+
+        if (rating) {
+        	ctx->enumerate_all = 0;
+                ctx->rating_mode = 1;
+                ctx->schedule = SCHED_STATIC;	/* the ladder needs the static order */
+                ctx->unique = UNIQUE_OFF;	/* and holds for any puzzle */
+                ctx->probing = 0;		/* without any trial */
         }
 
+        soln_list = collect_solns(ctx);
+
+        /* Check any deductions that assumed a unique solution */
+        if (ctx->unique == UNIQUE_VERIFY && ctx->rule[RULE_UNIQUE].hits &&
+            (ctx->status == SOLVE_OK || ctx->status == SOLVE_NOSOLUTION))
+        	soln_list = verify_unique(puzzle, soln_list);
+
         return soln_list;
 }
 
+/*****************************************************************/
+/* Set the budgets for solve_sudoku() and new contexts, and      */
+/* report the statistics and diagnostics of the last call to     */
+/* solve_sudoku().                                               */
+/*****************************************************************/
+
+void set_solve_limits(const SOLVE_LIMITS *lim)
+{
+	if (lim) limits = *lim;
+        else memset(&limits, 0, sizeof(SOLVE_LIMITS));
+}
+
+void set_rule_schedule(int schedule)
+{
+	rule_schedule = schedule;
+}
+
+void set_uniqueness(int mode)
+{
+	uniqueness = mode;
+}
+
+void set_probing(int enable)
+{
+	probing = enable;
+}
+
+int set_layout(int kind, const char *regions)
+{
+	int c, n[PUZZLE_DIM];
+
+        if (kind == LAYOUT_JIGSAW) {
+        	if (regions == NULL) return 0;
+                memset(n, 0, sizeof(n));
+                for (c = 0; c < PUZZLE_CELLS; c++) {
+                	if (regions[c] < '1' || regions[c] > '9' || ++n[regions[c] - '1'] > PUZZLE_DIM) return 0;
+                }
+                memcpy(layout_regions, regions, PUZZLE_CELLS);
+        }
+        else if (kind < LAYOUT_CLASSIC || kind > LAYOUT_JIGSAW) return 0;
+
+        layout_kind = kind;
+        return 1;
+}
+
+void solve_stats(SOLVE_STATS *st)
+{
+	if (last_ctx) solver_stats(last_ctx, st);
+        else memset(st, 0, sizeof(SOLVE_STATS));
+}
+
+void solve_diagnose(FILE *h)
+{
+	if (last_ctx) solver_diagnose(last_ctx, h);
+}
+
+/*****************************************************/
+/* Return a descriptive name for a difficulty grade. */
+/*****************************************************/
+
+const char *rating_name(int rating)
+{
+	static const char *names[RATE_TRIAL+1] = { "givens", "singles", "chutes", "tuples", "trial" };
+
+        if (rating < RATE_GIVENS) rating = RATE_GIVENS;
+        if (rating > RATE_TRIAL) rating = RATE_TRIAL;
+
+        return names[rating];
+}
+
+/*****************************************************************/
+/* Return the name of the kernel set in use, e.g. "avx2".        */
+/*****************************************************************/
+
+const char *engine_kernels(void)
+{
+	return kernel->name;
+}
+
 /*******************************************/
 /* Entry point if not properly initialized */
 /*******************************************/
 
-static Grid *_not_initialized(const char *puzzle)
+static Solution *_not_initialized(const char *puzzle, int rating)
 {
 	fprintf(stderr, "solve engine not properly initialized\n");
         exit(1);
 	return NULL;
 }
 
-typedef Grid *(*SOLVE_ENGINE)(const char *puzzle);
+typedef Solution *(*SOLVE_ENGINE)(const char *puzzle, int rating);
 
 static SOLVE_ENGINE solver_engine = _not_initialized;
 
@@ -1935,14 +3372,335 @@ static SOLVE_ENGINE solver_engine = _not_initialized;
 /* API entry point to the solver algorithm. */
 /********************************************/
 
-Grid *solve_sudoku(const char *puzzle)
+Solution *solve_sudoku(const char *puzzle)
 {
-	return solver_engine(puzzle);
+	return solver_engine(puzzle, 0);
 }
 
-static int default_callback(const Grid *g)
+/*****************************************************************/
+/* Rate the supplied puzzle by the hardest rule needed to reach  */
+/* its first solution. See the header file for details.          */
+/*****************************************************************/
+
+Solution *rate_sudoku(const char *puzzle)
 {
-	return 0;
+	return solver_engine(puzzle, 1);
+}
+
+
+#ifdef THREADS
+
+/*****************************************************************/
+/* Portfolio solving. The same puzzle is raced in several        */
+/* contexts, each with its own branching heuristic, one thread   */
+/* per context, and the first to settle the puzzle (by finding a */
+/* solution or exhausting the search) raises a flag that cancels */
+/* the others at their next node. The contexts, and with them    */
+/* their rule payoffs, are kept from one puzzle to the next.     */
+/*****************************************************************/
+
+#define MAX_PORTFOLIO 16
+
+typedef struct portfolio {
+	pthread_mutex_t lock;
+        volatile sig_atomic_t done;	/* raised by the first context to settle */
+        int winner;			/* index of that context, or -1          */
+} Portfolio;
+
+typedef struct racer {
+	SOLVER_CTX *ctx;
+        Portfolio *pf;
+        int id;
+        const Grid *soln;		/* first solution, if one was found      */
+} Racer;
+
+static SOLVER_CTX *portfolio_ctx[MAX_PORTFOLIO];
+
+static void *race(void *arg)
+{
+	Racer *r = arg;
+        Portfolio *pf = r->pf;
+
+        r->soln = solver_next(r->ctx);
+
+        /* A search that ran to the end settles the puzzle, one cut short does not */
+        if (r->ctx->status == SOLVE_OK || r->ctx->status == SOLVE_NOSOLUTION) {
+        	pthread_mutex_lock(&pf->lock);
+                if (pf->winner < 0) {
+                	pf->winner = r->id;
+                        RAISE_FLAG(&pf->done);
+                }
+                pthread_mutex_unlock(&pf->lock);
+        }
+
+        r->ctx->race = NULL;		/* the flag goes with the race */
+        return NULL;
+}
+
+Solution *solve_portfolio(const char *puzzle, int threads)
+{
+	static const int heuristic[3] = { BRANCH_FIRST, BRANCH_LAST, BRANCH_RANDOM };
+	Portfolio pf;
+        Racer racer[MAX_PORTFOLIO];
+        pthread_t tid[MAX_PORTFOLIO];
+        Solution *soln_list = NULL;
+        SOLVER_CTX *ctx;
+        int i, n;
+
+        if (!initialized) return _not_initialized(puzzle, 0);
+
+        if (threads > MAX_PORTFOLIO) threads = MAX_PORTFOLIO;
+#ifdef EXPLAIN
+	if (explain) threads = 1;	/* explanations of rival searches would interleave */
+#endif
+	if (threads < 1) threads = 1;
+
+        pf.done = 0;
+        pf.winner = -1;
+        pthread_mutex_init(&pf.lock, NULL);
+
+        for (i = 0; i < threads; i++) {
+        	if ((ctx = portfolio_ctx[i]) == NULL) {
+                	ctx = portfolio_ctx[i] = solver_create();
+                        solver_branching(ctx, heuristic[i < 2 ? i : 2], i);
+                }
+                ctx->limits = limits;
+
+                if (!solver_load(ctx, puzzle)) {
+                	last_ctx = ctx;
+                        while (i-- > 0) portfolio_ctx[i]->race = NULL;
+                        pthread_mutex_destroy(&pf.lock);
+                        return NULL;
+                }
+
+                ctx->race = &pf.done;
+
+                ctx->enumerate_all = 0;			/* the race is for the first solution */
+                ctx->callback = default_callback;	/* which may not be reentrant */
+
+                racer[i].ctx = ctx;
+                racer[i].pf = &pf;
+                racer[i].id = i;
+                racer[i].soln = NULL;
+        }
+
+        /* The calling thread runs the first context, the default heuristic */
+        for (n = 1; n < threads; n++) {
+        	if (pthread_create(&tid[n], NULL, race, &racer[n]) != 0) break;
+        }
+        for (i = n; i < threads; i++) racer[i].ctx->race = NULL;	/* never started */
+        race(&racer[0]);
+        while (--n > 0) pthread_join(tid[n], NULL);
+
+        pthread_mutex_destroy(&pf.lock);
+
+        i = pf.winner >= 0 ? pf.winner : 0;
+        last_ctx = racer[i].ctx;
+
+        /* Hand back the solution, or the unsolved grid if there is none */
+        add_grid(&soln_list, racer[i].soln ? racer[i].soln : solver_grid(racer[i].ctx));
+
+        return soln_list;
+}
+
+#endif
+
+/*****************************************************************/
+/* Clue analysis. The puzzle is solved once, then each given is  */
+/* tested alone: without it the puzzle is still unique if and    */
+/* only if no solution has another digit in its cell. The markup */
+/* of the givens is made once. A test copies it, takes the given */
+/* out as a session does (remarking only the cell and its        */
+/* peers), strikes the solution's digit from the cell's          */
+/* candidates, and looks for a first solution only, rather than  */
+/* counting to two. The tests do not depend on one another, so   */
+/* they are dealt out to threads, each with a context of its own */
+/* that is kept from one puzzle to the next.                     */
+/*****************************************************************/
+
+#define MAX_ANALYSTS 16
+
+typedef struct analyst {
+	SOLVER_CTX *ctx;
+        const Grid *base;		/* markup of the givens                   */
+        const char *answer;
+        const uint8_t *given;		/* the given cells                        */
+        int ngiven, first, stride;	/* and this analyst's share of them       */
+        char *clue;
+        int status;			/* SOLVE_TIMEOUT etc. if a test ran short */
+} Analyst;
+
+static SOLVER_CTX *analyst_ctx[MAX_ANALYSTS];
+
+/* Does the puzzle less the given in cell c have a solution other than answer? */
+static int clue_needed(SOLVER_CTX *ctx, const Grid *base, int c, const char *answer)
+{
+	Grid *g = &ctx->stack[0].grid;
+        int i;
+
+        if (base->givens - 1 < layout.min_givens) {	/* too few givens to be unique */
+        	ctx->status = SOLVE_FEWGIVENS;
+                return 1;
+        }
+
+        load_grid(ctx, base);
+        session_unsolve(g, c);
+        if ((g->cell[c] &= ~(1 << (answer[c] - '1'))) == 0) return 0;
+
+        /* The markup leaves naked singles unsolved; solve them, to be marked from */
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (!IS_SOLVED(g, i) && bitcount(g->cell[i]) == 1) {
+                	MARK_SOLVED(g, i);
+                        g->solved[g->exposed++] = i;
+                }
+        }
+
+        return solver_next(ctx) != NULL;
+}
+
+static void *analyze(void *arg)
+{
+	Analyst *a = arg;
+        int i, c;
+
+        for (i = a->first; i < a->ngiven; i += a->stride) {
+        	c = a->given[i];
+        	a->clue[c] = clue_needed(a->ctx, a->base, c, a->answer) ? CLUE_NEEDED : CLUE_REDUNDANT;
+                /* A search cut short proves nothing */
+                if (a->ctx->status == SOLVE_TIMEOUT || a->ctx->status == SOLVE_CANCELLED) {
+                	a->status = a->ctx->status;
+                        a->clue[c] = CLUE_NONE;
+                }
+        }
+
+        return NULL;
+}
+
+int analyze_clues(const char *puzzle, int threads, CLUE_REPORT *rep)
+{
+	Analyst analyst[MAX_ANALYSTS];
+        uint8_t given[PUZZLE_CELLS];
+        char answer[PUZZLE_CELLS+1];
+        Grid base;
+        const Grid *g;
+        SOLVER_CTX *ctx;
+        int i, c, n;
+#ifdef THREADS
+	pthread_t tid[MAX_ANALYSTS];
+#endif
+#ifdef EXPLAIN
+	int saved = explain;
+
+        explain = 0;
+#endif
+
+        if (!initialized) {
+		fprintf(stderr, "solve engine not properly initialized\n");
+	        exit(1);
+        }
+
+#ifndef THREADS
+	threads = 1;
+#endif
+        if (threads > MAX_ANALYSTS) threads = MAX_ANALYSTS;
+        if (threads < 1) threads = 1;
+
+        for (i = 0; i < threads; i++) {
+        	if (analyst_ctx[i] == NULL) analyst_ctx[i] = solver_create();
+                analyst_ctx[i]->limits = limits;
+                analyst_ctx[i]->limits.max_score = analyst_ctx[i]->limits.max_depth = 0;
+        }
+        ctx = analyst_ctx[0];
+
+        memset(rep, 0, sizeof(CLUE_REPORT));
+        rep->status = SOLVE_OK;
+
+        /* The puzzle must have a unique solution, which we keep */
+        if (solver_load(ctx, puzzle)) {
+	        ctx->callback = default_callback;
+	        ctx->unique = UNIQUE_OFF;
+	        ctx->enumerate_all = 1;
+
+	        if ((g = solver_next(ctx)) == NULL)
+	        	rep->status = ctx->status == SOLVE_OK ? SOLVE_NOSOLUTION : ctx->status;
+	        else {
+	        	format_answer(g, answer);
+	                if (solver_next(ctx) != NULL) rep->status = SOLVE_NOTUNIQUE;
+	                else if (ctx->status != SOLVE_OK) rep->status = ctx->status;
+	        }
+        }
+        else rep->status = ctx->status;
+
+        if (rep->status != SOLVE_OK) {
+#ifdef EXPLAIN
+		explain = saved;
+#endif
+        	return rep->status;
+        }
+
+        for (n = c = 0; c < PUZZLE_CELLS; c++) {
+        	if (puzzle[c] >= '1' && puzzle[c] <= '9') {
+                	given[n++] = c;
+                        rep->subset[c] = puzzle[c];
+                }
+                else rep->subset[c] = '.';
+        }
+        rep->givens = n;
+        session_markup(&base, rep->subset);
+
+        /* Test each given alone */
+        for (i = 0; i < threads; i++) {
+        	analyst[i].ctx = analyst_ctx[i];
+                analyst[i].base = &base;
+                analyst[i].answer = answer;
+                analyst[i].given = given;
+                analyst[i].ngiven = n;
+                analyst[i].first = i;
+                analyst[i].stride = threads;
+                analyst[i].clue = rep->clue;
+                analyst[i].status = SOLVE_OK;
+        }
+
+#ifdef THREADS
+        for (n = 1; n < threads; n++) {
+        	if (pthread_create(&tid[n], NULL, analyze, &analyst[n]) != 0) break;
+        }
+        for (i = n; i < threads; i++) analyze(&analyst[i]);	/* threads that could not be had */
+        analyze(&analyst[0]);
+        while (--n > 0) pthread_join(tid[n], NULL);
+#else
+        analyze(&analyst[0]);
+#endif
+
+        for (i = 0; i < threads; i++) {
+        	if (analyst[i].status != SOLVE_OK) rep->status = analyst[i].status;
+        }
+
+        /*********************************************************/
+        /* Then remove the redundant givens one by one, testing  */
+        /* each again as the puzzle shrinks. A given needed in   */
+        /* the whole puzzle is needed in any part of it, so only */
+        /* the redundant ones need testing.                      */
+        /*********************************************************/
+
+        for (c = 0; c < PUZZLE_CELLS; c++) {
+        	if (rep->clue[c] == CLUE_NEEDED) rep->minimal++;
+                if (rep->clue[c] != CLUE_REDUNDANT) continue;
+                rep->redundant++;
+                if (clue_needed(ctx, &base, c, answer) || ctx->status == SOLVE_TIMEOUT || ctx->status == SOLVE_CANCELLED) rep->minimal++;
+                else {
+                	rep->subset[c] = '.';
+                        session_unsolve(&base, c);
+                }
+                if (ctx->status == SOLVE_TIMEOUT || ctx->status == SOLVE_CANCELLED) rep->status = ctx->status;
+        }
+        rep->subset[PUZZLE_CELLS] = 0;
+
+#ifdef EXPLAIN
+	explain = saved;
+#endif
+
+        return rep->status;
 }
 
 /*************************************************************************/
@@ -1962,8 +3720,8 @@ static int default_callback(const Grid *g)
 /* NULL is supplied.)                                                    */
 /*                                                                       */
 /* Similarly, the third parameter is a FILE pointer where diagnostics    */
-/* are written when a puzzle is insoluble (defaults to stderr if NULL is */
-/* supplied.)                                                            */
+/* for rejected or insoluble puzzles are written by solve_diagnose()     */
+/* (defaults to stderr if NULL is supplied.)                             */
 /*                                                                       */
 /* The fourth parameter is a flag that, when non-zero, requests that the */
 /* solver engine stop enumeration after finding the first solution.      */
@@ -1987,7 +3745,7 @@ const char *init_solve_engine(RETURN_SOLN solution_callback, FILE *solns, FILE *
         sprintf(version, "Sudoku Engine version %s\n", VERSION);
 
 #ifdef EXPLAIN
-	explain = explanation;
+	explain = explanation && layout_kind == LAYOUT_CLASSIC;	/* the layout kernels have no hooks */
         solnfile = solns ? solns : stdout;
 #endif
 
@@ -1997,7 +3755,12 @@ const char *init_solve_engine(RETURN_SOLN solution_callback, FILE *solns, FILE *
 
 	soln_callback = solution_callback ? solution_callback : default_callback;
 
+        build_layout();
+        select_kernels();
+        init_zobrist();
+
         solver_engine = _solve_sudoku;
+        initialized = 1;
 
         return version;
 }
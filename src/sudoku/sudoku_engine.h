@@ -1 +0,0 @@
-solver_1.20/sudoku_engine.h
\ No newline at end of file
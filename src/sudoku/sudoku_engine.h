@@ -0,0 +1,681 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Author: Bill DuPree                                                              */
+/* Name: sudoku_solver.c                                                            */
+/* Language: C                                                                      */
+/* Inception: Feb. 25, 2006                                                         */
+/* Copyright (C) August 17, 2008, All rights reserved.                              */
+/*                                                                                  */
+/* This is a program that solves Su Doku (aka Sudoku, Number Place, etc.) puzzles   */
+/* primarily using deductive logic. It will only resort to trial-and-error and      */
+/* backtracking approaches upon exhausting all of its deductive moves. See the C    */
+/* source code for more detailed information.                                       */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/* This program is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of                   */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                    */
+/* GNU General Public License for more details.                                     */
+/*                                                                                  */
+/* You should have received a copy of the GNU General Public License                */
+/* along with this program; if not, write to the Free Software                      */
+/* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA       */
+/*                                                                                  */
+/* CONTACT:                                                                         */
+/*                                                                                  */
+/* Email: bdupree@techfinesse.com                                                   */
+/* Post: Bill DuPree, 609 Wenonah Ave, Oak Park, IL 60304 USA                       */
+/*                                                                                  */
+/************************************************************************************/
+/*                                                                                  */
+/* CHANGE LOG:                                                                      */
+/*                                                                                  */
+/* Rev.	  Date        Init.	Description                                         */
+/* -------------------------------------------------------------------------------- */
+/* 1.00   2006-02-25  WD	Initial version.                                    */
+/* 1.01   2006-03-13  WD	Fixed return code calc. Added signon message.       */
+/* 1.10   2006-03-20  WD        Added explain option, add'l speed optimizations     */
+/* 1.11   2006-03-23  WD        More simple speed optimizations, cleanup, bug fixes */
+/* 1.20   2008-08-17  WD        Fix early recursion. Rewrite markup, subset and     */
+/*                              box-line interaction. Add bottleneck detection and  */
+/*                              other scoring enhancements. Allow linkage to        */
+/*                              sudoku_engine as a reusable object module.          */
+/*                              (Thanks to Giuseppe Matarazzo for his suggestions.) */
+/*                                                                                  */
+/************************************************************************************/
+
+#ifndef _SUDSOLVER_H_
+
+#define _SUDSOLVER_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Baseline puzzle parameters */
+#define PUZZLE_ORDER 3
+#define PUZZLE_DIM (PUZZLE_ORDER*PUZZLE_ORDER)
+#define PUZZLE_CELLS (PUZZLE_DIM*PUZZLE_DIM)
+
+/* Return codes for funcs that modify puzzle markup, and SOLVED for a search level */
+#define NOCHANGE 0
+#define CHANGE   1
+#define SOLVED   2
+#define IMPASSE  3
+
+/* Difficulty grades for the rating member, i.e. the hardest rule needed */
+#define RATE_GIVENS  0		/* No deduction needed, all cells given     */
+#define RATE_SINGLES 1		/* Markup and naked/hidden singles          */
+#define RATE_CHUTES  2		/* Box-line (chute) interactions            */
+#define RATE_TUPLES  3		/* Naked/hidden subsets                     */
+#define RATE_TRIAL   4		/* Trial-and-error, plus one per extra lvl  */
+
+/* Outcome of a search, as reported in the status member of SOLVE_STATS */
+#define SOLVE_OK            0	/* solved, or stopped by the callback       */
+#define SOLVE_TIMEOUT       1	/* node or time budget exhausted            */
+#define SOLVE_CANCELLED     2	/* cancel token was raised                  */
+#define SOLVE_BADFORMAT     3	/* fewer than 81 cells                      */
+#define SOLVE_FEWGIVENS     4	/* fewer than 17 givens (8, see set_layout()) */
+#define SOLVE_CONTRADICTION 5	/* a digit is given twice in a unit         */
+#define SOLVE_NOSOLUTION    6	/* search exhausted without a solution      */
+#define SOLVE_NOTUNIQUE     7	/* more than one solution, see analyze_clues() */
+#define SOLVE_TOOHARD       8	/* score or depth bound passed, no solution */
+
+/* Kinds of unit, as reported in the unit_type member of SOLVE_STATS */
+#define UNIT_NONE 0
+#define UNIT_ROW  1
+#define UNIT_COL  2
+#define UNIT_BOX  3
+#define UNIT_EXTRA 4		/* a diagonal or window, see set_layout()   */
+
+/* Layouts, see set_layout() */
+#define LAYOUT_CLASSIC 0	/* rows, columns and 3x3 boxes              */
+#define LAYOUT_X       1	/* and the two long diagonals               */
+#define LAYOUT_WINDOKU 2	/* and four more 3x3 boxes                  */
+#define LAYOUT_JIGSAW  3	/* irregular boxes                          */
+
+/* Outcome of checking a submitted solution, see check_solutions() */
+#define CHECK_OK        0	/* a complete solution of the puzzle        */
+#define CHECK_BADFORMAT 1	/* a cell is not a digit 1-9, or too short  */
+#define CHECK_GIVEN     2	/* a cell differs from the puzzle's given   */
+#define CHECK_UNIT      3	/* a digit is repeated in a unit            */
+
+/* Verdicts on the cells of a puzzle, see analyze_clues() */
+#define CLUE_NONE      0	/* not a given                              */
+#define CLUE_NEEDED    1	/* without it the puzzle is not unique      */
+#define CLUE_REDUNDANT 2	/* the puzzle is still unique without it    */
+
+/* Advanced deductive rules, as indexed in the rule member of SOLVE_STATS */
+#define RULE_CHUTES 0		/* Box-line (chute) interactions            */
+#define RULE_TUPLES 1		/* Naked/hidden subsets                     */
+#define RULE_UNIQUE 2		/* Unique rectangles and BUG+1 (opt-in)     */
+#define RULE_PROBE  3		/* Failed literal probing (opt-in)          */
+#define NUM_RULES   4
+
+/* Rule schedules, see set_rule_schedule() */
+#define SCHED_STATIC   0	/* chutes then tuples, every round          */
+#define SCHED_ADAPTIVE 1	/* ordered and thinned by observed payoff   */
+
+/* Uniqueness modes, see set_uniqueness() */
+#define UNIQUE_OFF    0		/* make no assumption about the puzzle      */
+#define UNIQUE_ASSUME 1		/* assume the solution is unique            */
+#define UNIQUE_VERIFY 2		/* assume it, then check with a plain search */
+
+/* Branching heuristics, see solver_branching() */
+#define BRANCH_FIRST  0		/* first cell with fewest candidates, 1 to 9 */
+#define BRANCH_LAST   1		/* last such cell, candidates 9 down to 1   */
+#define BRANCH_RANDOM 2		/* any such cell, in either order, at random */
+
+/* Number of 32 bit words in a one bit per cell bitmap */
+#define GRID_MAP_WORDS ((PUZZLE_CELLS + 31) / 32)
+
+/* Search state of a puzzle. This is copied at every level of trial-and-error, */
+/* so it is kept compact: 16 bit candidate masks, a byte sized queue of solved */
+/* cells awaiting markup, and solved/given state held in bitmaps.              */
+typedef struct grd {
+	uint16_t cell[PUZZLE_CELLS];		/* candidate mask of each cell    */
+        uint8_t solved[PUZZLE_CELLS];		/* solved cells, in solving order */
+        uint8_t tail, givens, exposed, maxlvl, inc, rating;
+        uint16_t reward, pass_mods;
+        uint32_t solvedmap[GRID_MAP_WORDS];	/* given or solved cells          */
+        uint32_t givenmap[GRID_MAP_WORDS];	/* given cells                    */
+        unsigned int score, solncount;
+} Grid;
+
+/* A list of solutions as returned by the solver engine */
+typedef struct soln {
+	Grid grid;
+        struct soln *next;
+} Solution;
+
+/********************************************************/
+/* Type definition for a user defined callback function */
+/********************************************************/
+
+typedef int (*RETURN_SOLN)(const Grid *g);
+
+/*****************************************************************/
+/* Opaque solver context for enumerating solutions on demand     */
+/*****************************************************************/
+
+typedef struct solver_ctx SOLVER_CTX;
+
+/*****************************************************************/
+/* Opaque interactive session, and a hint for the next step      */
+/*****************************************************************/
+
+typedef struct solver_session SOLVER_SESSION;
+
+typedef struct hint {
+	int cell;				/* cell to solve (0 based), or -1 */
+        int digit;				/* digit to place there, 1 to 9   */
+        int rating;				/* hardest rule needed, RATE_*    */
+} HINT;
+
+/*****************************************************************/
+/* Budgets for a single solve. A zero member means no limit. The */
+/* cancel member, if not NULL, points to a flag that the caller  */
+/* may set non-zero at any time, e.g. from a signal handler or   */
+/* another thread, to stop the search at the next node. The      */
+/* engine reads it with __atomic_load_n(), so another thread     */
+/* must set it with __atomic_store_n() (any memory order will    */
+/* do), not a plain assignment. A signal handler may assign it.  */
+/*                                                               */
+/* The score and depth of a solution are those reached when it   */
+/* is found, and both only grow as the search goes on. So once   */
+/* either passes its bound with no solution yet found, any       */
+/* solution would be out of bounds too, and the search stops     */
+/* with SOLVE_TOOHARD. This lets a corpus be filtered by         */
+/* difficulty without searching the hard puzzles to the end.     */
+/* The bounds do not apply to counting, which has no score.      */
+/*****************************************************************/
+
+typedef struct solve_limits {
+	unsigned long max_nodes;		/* trial-and-error levels entered */
+        unsigned long max_msecs;		/* elapsed (wall clock) time      */
+        volatile sig_atomic_t *cancel;		/* cooperative cancel token       */
+        unsigned int max_score;			/* score, as of the first solution */
+        int max_depth;				/* depth, likewise                */
+} SOLVE_LIMITS;
+
+/*****************************************************************/
+/* Statistics of the most recent solve. If the search ran out of */
+/* budget they describe the partial search up to the point it    */
+/* was stopped, and only the solutions found so far are known.   */
+/* If the puzzle was rejected, the status says why, and the unit */
+/* and/or cell at fault are given where they are known.          */
+/*****************************************************************/
+
+typedef struct rule_stats {
+	unsigned long calls;			/* times the rule was applied     */
+        unsigned long hits;			/* times it changed the markup    */
+        unsigned long skips;			/* times the scheduler passed it  */
+} RULE_STATS;
+
+typedef struct solve_stats {
+	int status;				/* SOLVE_OK, SOLVE_TIMEOUT, etc.  */
+        unsigned long nodes;			/* trial-and-error levels entered */
+        unsigned long msecs;			/* elapsed time of the search     */
+        unsigned int solncount, score;
+        int maxlvl;
+        RULE_STATS rule[NUM_RULES];		/* indexed by RULE_CHUTES, etc.   */
+        int unit_type, unit;			/* failing unit (0 based), if any */
+        int cell;				/* failing cell (0 based), or -1  */
+        unsigned long tt_hits;			/* subtrees counted from ttable   */
+        int refuted;				/* puzzle proved not to be unique */
+} SOLVE_STATS;
+
+/* The first error found in a submitted solution, if any */
+typedef struct check_result {
+	int status;				/* CHECK_OK, CHECK_GIVEN, etc.    */
+        int unit_type, unit;			/* unit repeating a digit, if any */
+        int cell;				/* cell at fault (0 based), or -1 */
+} CHECK_RESULT;
+
+/* Which givens of a puzzle are needed, see analyze_clues() */
+typedef struct clue_report {
+	int status;				/* SOLVE_OK, SOLVE_NOTUNIQUE, etc. */
+        int givens, redundant, minimal;		/* numbers of givens               */
+        char clue[PUZZLE_CELLS];		/* CLUE_NEEDED etc., by cell       */
+        char subset[PUZZLE_CELLS+1];		/* puzzle of a minimal subset      */
+} CLUE_REPORT;
+
+/*****************************************************/
+/* Function prototype(s) for the solver engine API's */
+/*****************************************************/
+
+/****************************************************************************/
+/* Function to print a sudoku puzzle Grid as an 81 character ASCIIZ string. */
+/* The first parameter is a pointer to a Grid structure (which is the       */
+/* internal representation used by the solver engine.) The second           */
+/* parameter is a pointer to an 82 character output buffer which is to      */
+/* receive the puzzle string. In the output string, solved puzzle cells     */
+/* will be converted to their assigned number, and unsolved cells will be   */
+/* represented as the period , i.e. '.', character. A pointer to the        */
+/* output buffer is returned. Results are undefined if the output buffer    */
+/* is less than 82 characters in length.                                    */
+/****************************************************************************/
+
+char *format_answer(const Grid *g, char *outbuf);
+
+/*******************************************************************************************/
+/* Print the (presumably solved) 81 character puzzle string, 'sud', as a standard 9x9 grid */
+/* to the given file. No value is returned. Results are undefined if sud is not an 81      */
+/* character string                                                                        */
+/*******************************************************************************************/
+
+void print_grid(const char *sud, FILE *h);
+
+/**********************************************************************/
+/* Print the partially solved puzzle, 'g', and all associated markup  */
+/* in 9x9 fashion to the file, 'h'. Note, markup is not printed if    */
+/* the puzzle is already solved. No value is returned.                */
+/**********************************************************************/
+
+void diagnostic_grid(const Grid *g, FILE *h);
+
+/*************************************************************************/
+/* Setup parameters for sudoku solver engine.                            */
+/*                                                                       */
+/* The first parameter is a pointer to a user supplied callback function */
+/* that will be called every time a solution is found. The supplied      */
+/* pointer may be NULL if no callback is desired. The callback function  */
+/* is presented with a solved Grid structure when it is called. It is    */
+/* expected to return an integer to the solver engine where a zero       */
+/* indicates that the engine should continue enumerating solutions, and  */
+/* a non-zero value indicates that the solver should cancel further      */
+/* enumeration. (See RETURN_SOLN typedef defined above.)                 */
+/*                                                                       */
+/* The second parameter is a FILE pointer (which may be NULL) where      */
+/* solution explanations are written if desired (defaults to stdout if   */
+/* NULL is supplied.)                                                    */
+/*                                                                       */
+/* Similarly, the third parameter is a FILE pointer where diagnostics    */
+/* for rejected or insoluble puzzles are written by solve_diagnose()     */
+/* (defaults to stderr if NULL is supplied.)                             */
+/*                                                                       */
+/* The fourth parameter is a flag that, when non-zero, requests that the */
+/* solver engine stop enumeration after finding the first solution.      */
+/*                                                                       */
+/* The fifth parameter is also a flag that, when non-zero, requests that */
+/* the steps to a solution (i.e. an explanation) are written to the      */
+/* output file (specified by the second parameter.)                      */
+/*                                                                       */
+/* Finally, the return value supplied by the function is a version       */
+/* string for the solver engine.                                         */
+/*                                                                       */
+/* This function may be interleaved with calls to solve_sudoku() to      */
+/* change settings as needed.                                            */
+/*************************************************************************/
+
+const char *init_solve_engine(RETURN_SOLN solution_callback, FILE *solns, 
+                              FILE *reject, int first_soln_only, int explanation);
+
+/*****************************************************************/
+/* Sudoku puzzle solver engine entry point.                      */
+/*                                                               */
+/* Solve the supplied 81 character puzzle, if solvable. Return a */
+/* list of solutions which enumerate all possible solutions. If  */
+/* no solution exists, the list will contain a single partially  */
+/* completed grid, and the solncount member will be set to zero. */
+/* Note that only the first 81 characters of the supplied puzzle */
+/* argument string are examined; any excess is ignored. The      */
+/* calling application should use the free_soln_list() function  */
+/* to properly dispose of the returned list after it has         */
+/* finished processing the results.                              */
+/*****************************************************************/
+
+Solution *solve_sudoku(const char *puzzle);
+
+/*****************************************************************/
+/* This function is used to free the allocated list of solutions */
+/* returned by the solve_sudoku() function.                      */
+/*****************************************************************/
+
+void free_soln_list(Solution *soln_list);
+
+/*****************************************************************/
+/* Rate the supplied 81 character puzzle without enumerating all */
+/* of its solutions. The deductive rules are applied as a ladder */
+/* (singles, chutes, tuples and finally trial-and-error) and the */
+/* search stops at the first solution, regardless of the setting */
+/* made by init_solve_engine(). The rating member of the         */
+/* returned grid holds the grade of the hardest rule needed (see */
+/* the RATE_* values above.) The return value is otherwise the   */
+/* same as for solve_sudoku() and must be disposed of with       */
+/* free_soln_list().                                             */
+/*****************************************************************/
+
+Solution *rate_sudoku(const char *puzzle);
+
+/*****************************************************************/
+/* Return a short descriptive name for a difficulty rating as    */
+/* found in the rating member of a Grid, e.g. "chutes".          */
+/*****************************************************************/
+
+const char *rating_name(int rating);
+
+/*****************************************************************/
+/* Return the name of the instruction set variant of the solver  */
+/* kernels chosen by init_solve_engine() for the CPU at hand,    */
+/* i.e. "scalar", "sse42", "avx2" or "avx512", or "explain" if   */
+/* it was asked for explanations (and EXPLAIN was defined.) See  */
+/* set_layout() for those of the variant layouts.                */
+/*****************************************************************/
+
+const char *engine_kernels(void);
+
+/*****************************************************************/
+/* Solution iterator API.                                        */
+/*                                                               */
+/* As an alternative to solve_sudoku(), solutions may be pulled  */
+/* from the engine one at a time. A context is allocated with    */
+/* solver_create() (after init_solve_engine() has been called)   */
+/* and released with solver_destroy(). It may be reused for any  */
+/* number of puzzles.                                            */
+/*                                                               */
+/* solver_load() loads an 81 character puzzle into the context,  */
+/* and returns zero if the puzzle is bogus, non-zero otherwise.  */
+/*                                                               */
+/* solver_next() resumes the search and returns the next         */
+/* solution, or NULL once all solutions have been enumerated (or */
+/* after the first one if init_solve_engine() was so told.) The  */
+/* returned grid belongs to the context and is only valid until  */
+/* the next call. The caller may stop at any point, and may load */
+/* another puzzle without exhausting the current one. The search */
+/* keeps its trial-and-error levels on a stack in the context    */
+/* rather than recursing, so its C stack usage is small and does */
+/* not depend on the depth of the search.                        */
+/*                                                               */
+/* solver_grid() returns the root grid of the loaded puzzle.     */
+/* Once solver_next() has returned NULL, its solncount member    */
+/* holds the number of solutions found, and if there were none,  */
+/* the grid is the partially completed puzzle, suitable for      */
+/* diagnostic_grid().                                            */
+/*****************************************************************/
+
+SOLVER_CTX *solver_create(void);
+int solver_load(SOLVER_CTX *ctx, const char *puzzle);
+const Grid *solver_next(SOLVER_CTX *ctx);
+const Grid *solver_grid(const SOLVER_CTX *ctx);
+void solver_destroy(SOLVER_CTX *ctx);
+
+/*****************************************************************/
+/* Solution counting.                                            */
+/*                                                               */
+/* solver_count() counts all solutions of the puzzle just loaded */
+/* into a context, instead of calling solver_next(), and returns */
+/* the count. The solution callback is not called, and score and */
+/* depth are not meaningful. Where the unsolved cells fall apart */
+/* into groups that share no candidate within any unit, each     */
+/* group is counted alone and the counts are multiplied, rather  */
+/* than the groups' choices being searched in every combination. */
+/*                                                               */
+/* solver_ttable() gives the context a transposition table of at */
+/* most max_bytes (zero for none, the default.) While counting,  */
+/* the number of solutions below each markup state met during    */
+/* trial-and-error is kept in the table, so a state reached      */
+/* again by another order of trials is not searched again. This  */
+/* pays off for puzzles with few givens and many solutions. The  */
+/* table is kept from one puzzle to the next.                    */
+/*****************************************************************/
+
+unsigned int solver_count(SOLVER_CTX *ctx);
+void solver_ttable(SOLVER_CTX *ctx, size_t max_bytes);
+
+/*****************************************************************/
+/* Search budgets and statistics.                                */
+/*                                                               */
+/* set_solve_limits() sets the budgets applied to solve_sudoku() */
+/* and rate_sudoku(), and the defaults for contexts created      */
+/* afterwards. A NULL argument removes all limits.               */
+/* solver_limits() sets the budgets of a single context. The     */
+/* budgets are checked once per level of trial-and-error, so the */
+/* cost of checking them is negligible.                          */
+/*                                                               */
+/* solver_stats() fills in the statistics of the puzzle loaded   */
+/* into a context, and solve_stats() those of the last call to   */
+/* solve_sudoku() or rate_sudoku(). A solve that ran out of      */
+/* budget with no solution returns the partially completed grid  */
+/* with solncount zero, just as for an insoluble puzzle, so the  */
+/* status is the way to tell the two apart.                      */
+/*****************************************************************/
+
+void set_solve_limits(const SOLVE_LIMITS *limits);
+void solver_limits(SOLVER_CTX *ctx, const SOLVE_LIMITS *limits);
+void solver_stats(const SOLVER_CTX *ctx, SOLVE_STATS *stats);
+void solve_stats(SOLVE_STATS *stats);
+
+/*****************************************************************/
+/* Write a human readable explanation of why a puzzle was        */
+/* rejected, or why it has no solution, to the given file (the   */
+/* reject file of init_solve_engine() if NULL.) The engine never */
+/* writes diagnostics of its own accord; solver_diagnose()       */
+/* explains the puzzle loaded into a context, solve_diagnose()   */
+/* the last call to solve_sudoku() or rate_sudoku(). Nothing is  */
+/* written if the puzzle was solved.                             */
+/*****************************************************************/
+
+void solver_diagnose(const SOLVER_CTX *ctx, FILE *h);
+void solve_diagnose(FILE *h);
+
+/*****************************************************************/
+/* Select the order in which the advanced deductive rules are    */
+/* applied to puzzles loaded from now on. SCHED_STATIC, the      */
+/* default, applies chute elimination and then subset (tuple)    */
+/* elimination every round, which is reproducible. With          */
+/* SCHED_ADAPTIVE each context keeps a running tally of how      */
+/* often each rule changes the markup, weighed against the time  */
+/* a call is measured to take, across the puzzles it solves. The */
+/* rule with the better payoff is tried first, and a rule that   */
+/* rarely pays off is only tried now and then. The solutions     */
+/* found are the same either way, but the score, the explanation */
+/* and the amount of trial-and-error may differ, and as the      */
+/* timings vary, from one run to the next. Rating always uses    */
+/* the static schedule.                                          */
+/*****************************************************************/
+
+void set_rule_schedule(int schedule);
+
+/*****************************************************************/
+/* Select whether puzzles loaded from now on may be assumed to   */
+/* have a unique solution. With UNIQUE_ASSUME, unique rectangle  */
+/* and BUG+1 deductions are applied after the other rules, ahead */
+/* of trial-and-error, and are counted under RULE_UNIQUE. On a   */
+/* puzzle with more than one solution they may lose solutions,   */
+/* or find none at all. UNIQUE_VERIFY makes solve_sudoku() check */
+/* any puzzle on which they fired with a second search without   */
+/* them, reporting that search instead (and setting refuted in   */
+/* the stats) if the two disagree. Contexts treat UNIQUE_VERIFY  */
+/* as UNIQUE_ASSUME. Rating, counting and hints never assume     */
+/* uniqueness. UNIQUE_OFF is the default.                        */
+/*****************************************************************/
+
+void set_uniqueness(int mode);
+
+/*****************************************************************/
+/* Enable (non-zero) or disable failed literal probing for the   */
+/* puzzles loaded from now on. Before a level of trial-and-error */
+/* is entered, up to 16 cells with two candidates are probed:    */
+/* each value is tried on a copy with only markup and singles    */
+/* applied, a value that fails at once is removed, and so is any */
+/* candidate that both values remove. This costs time per level  */
+/* but often saves levels on hard puzzles. It is counted under   */
+/* RULE_PROBE, is never applied when rating, and is off by       */
+/* default.                                                      */
+/*****************************************************************/
+
+void set_probing(int enable);
+
+/*****************************************************************/
+/* Select the layout of the puzzles solved after the next call   */
+/* of init_solve_engine(), which builds the tables of units and  */
+/* peers for it: LAYOUT_X adds the two long diagonals as units,  */
+/* LAYOUT_WINDOKU four 3x3 windows (their top left cells at rows */
+/* and columns 2 and 6), and LAYOUT_JIGSAW takes its boxes from  */
+/* regions, 81 characters '1' to '9' giving the box of each cell */
+/* (nine cells to a box). It returns zero, leaving the layout as */
+/* it was, if the layout or its regions are not valid.           */
+/*                                                               */
+/* The classic layout keeps its own kernels, built on its fixed  */
+/* tables. The others share a set built on the layout's tables,  */
+/* without unique rectangles and BUG+1 (which do not hold with   */
+/* extra units), or, for jigsaws, chutes; engine_kernels() names */
+/* it "layout" or "jigsaw". Puzzles need at least 8 givens       */
+/* rather than 17, and a unit repeating a digit may be reported  */
+/* as UNIT_EXTRA, numbered from 0 in the order above. There are  */
+/* no explanations but for the classic layout. Contexts and      */
+/* sessions made under one layout are not to be used under       */
+/* another.                                                      */
+/*****************************************************************/
+
+int set_layout(int layout, const char *regions);
+
+/*****************************************************************/
+/* Branching and portfolio solving.                              */
+/*                                                               */
+/* solver_branching() selects how a context picks the cell and   */
+/* the order of candidates for trial-and-error. BRANCH_FIRST is  */
+/* the default; the seed only matters for BRANCH_RANDOM. All     */
+/* heuristics find the same solutions, in different orders and  */
+/* with different amounts of search.                             */
+/*                                                               */
+/* When built with -DTHREADS, solve_portfolio() races up to 16   */
+/* contexts with different heuristics on the same puzzle, one    */
+/* per thread, and returns the first solution found by any of    */
+/* them, as for solve_sudoku() with first_soln_only set. The     */
+/* others are cancelled as soon as one settles the puzzle. The   */
+/* solution callback is not called, and explanations force a     */
+/* single thread. The budgets of set_solve_limits() apply to     */
+/* each context, and solve_stats() reports on the winner. It may */
+/* not be called from more than one thread at a time.            */
+/*****************************************************************/
+
+void solver_branching(SOLVER_CTX *ctx, int heuristic, unsigned long seed);
+#ifdef THREADS
+Solution *solve_portfolio(const char *puzzle, int threads);
+#endif
+
+/*****************************************************************/
+/* Interactive session API.                                      */
+/*                                                               */
+/* A session holds one puzzle in play, with the markup that      */
+/* follows from its givens and the digits placed so far. Edits   */
+/* update the markup of the peers of the edited cell only, and   */
+/* the session never fills in cells by itself. Cells are indexed */
+/* 0 to 80, left to right and top to bottom, and digits are 1 to */
+/* 9. Hints that need trial-and-error need init_solve_engine()   */
+/* to have been called.                                          */
+/*                                                               */
+/* session_load() starts a new puzzle from an 81 character       */
+/* string. session_place() and session_clear() place or clear    */
+/* one of the player's digits, while session_add_given() and     */
+/* session_remove_given() edit the givens. These return SOLVE_OK */
+/* on success, SOLVE_CONTRADICTION (leaving the cell empty) if   */
+/* the digit is already solved in one of the cell's units, or    */
+/* SOLVE_BADFORMAT for an out of range argument, a given to be   */
+/* placed over or cleared by the player, or a short puzzle.      */
+/*                                                               */
+/* session_hint() finds the next cell that may be solved, the    */
+/* digit to place there, and the hardest rule needed to see it.  */
+/* If the puzzle is complete it returns SOLVE_OK with a cell of  */
+/* -1. If the digits placed so far leave no solution it returns  */
+/* SOLVE_NOSOLUTION. Hints print no explanations, and do not     */
+/* assume a unique solution whatever set_uniqueness() says.      */
+/*                                                               */
+/* session_grid() returns the puzzle in play. Its solvedmap and  */
+/* givenmap bitmaps tell the givens and placed digits from the   */
+/* markup of the cells still to be solved.                       */
+/*****************************************************************/
+
+SOLVER_SESSION *session_create(void);
+int session_load(SOLVER_SESSION *s, const char *puzzle);
+int session_place(SOLVER_SESSION *s, int cell, int digit);
+int session_clear(SOLVER_SESSION *s, int cell);
+int session_add_given(SOLVER_SESSION *s, int cell, int digit);
+int session_remove_given(SOLVER_SESSION *s, int cell);
+int session_hint(SOLVER_SESSION *s, HINT *hint);
+const Grid *session_grid(const SOLVER_SESSION *s);
+void session_destroy(SOLVER_SESSION *s);
+
+/*****************************************************************/
+/* Clue analysis.                                                */
+/*                                                               */
+/* analyze_clues() finds which givens of a puzzle with a unique  */
+/* solution are redundant, i.e. each could be removed alone and  */
+/* the puzzle would still be unique, and which are needed. The   */
+/* clue member gives the verdict for each cell. The subset is    */
+/* the puzzle less as many redundant givens as can be removed    */
+/* together (in cell order), which leaves a minimal puzzle: one  */
+/* from which no further given can be removed. The givens,       */
+/* redundant and minimal members count the givens of the puzzle, */
+/* those found redundant and those left in the subset.           */
+/*                                                               */
+/* Each given costs one search for a solution that differs in    */
+/* its cell, not a count of all solutions. When built with       */
+/* -DTHREADS the givens are tested in parallel, by up to 16      */
+/* threads; otherwise the threads argument is ignored.           */
+/*                                                               */
+/* It returns the status it records in the report: SOLVE_OK, a   */
+/* reason the puzzle was rejected, SOLVE_NOSOLUTION, or          */
+/* SOLVE_NOTUNIQUE if it has more than one solution, in which    */
+/* case there is nothing to report. The budgets of               */
+/* set_solve_limits() apply to each search, and SOLVE_TIMEOUT    */
+/* means some verdicts are missing (CLUE_NONE) and the subset    */
+/* may not be minimal. It may not be called from more than one   */
+/* thread at a time.                                             */
+/*****************************************************************/
+
+int analyze_clues(const char *puzzle, int threads, CLUE_REPORT *rep);
+
+/*****************************************************************/
+/* Submission checker.                                           */
+/*                                                               */
+/* check_solution() checks a submitted 81 character solution     */
+/* against its puzzle, without solving the puzzle: each cell     */
+/* must hold a digit 1-9, the givens of the puzzle must be kept, */
+/* and every row, column and box must hold each digit once. It   */
+/* returns the status it records in the result, CHECK_OK or the  */
+/* first error found, checked in that order (cells and units     */
+/* left to right, top to bottom, then rows, columns and boxes.)  */
+/* For CHECK_UNIT the cell is the second holding the digit.      */
+/*                                                               */
+/* check_solutions() checks n submissions, results[i] receiving  */
+/* the outcome of answers[i] against puzzles[i], and returns the */
+/* number found valid.                                           */
+/*                                                               */
+/* Neither needs init_solve_engine(), but the instruction set    */
+/* variant it selects is used once it has been called. Both are  */
+/* safe to call from any number of threads at once.              */
+/*****************************************************************/
+
+int check_solution(const char *puzzle, const char *answer, CHECK_RESULT *res);
+size_t check_solutions(const char * const *puzzles, const char * const *answers, size_t n, CHECK_RESULT *results);
+
+/**************************************************************/
+/* Based upon the unsolved Left-to-Right-Top-to-Bottom puzzle */
+/* presented in "sbuf", create a 27 octal digit mask of the   */
+/* givens in the 28 character buffer pointed to by "mbuf."    */
+/* Return a pointer to mbuf after conversion or NULL if sbuf  */
+/* contains less than 81 characters. Results are undefined if */
+/* mbuf is less than 28 characters in length.                 */
+/**************************************************************/
+
+char *cvt_to_mask(char *mbuf, const char *sbuf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
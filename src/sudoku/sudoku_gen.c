@@ -0,0 +1,419 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_gen.c                                                               */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* Generates a reproducible corpus of puzzles for performance regression runs of    */
+/* the solver. The puzzles come in classes that each stress one path through the    */
+/* engine, so that a change in the time taken by one class points at the rule (or   */
+/* check) responsible, where a change over a set of hard puzzles does not:          */
+/*                                                                                  */
+/*      easy            unique, solved by markup and singles alone                  */
+/*      chutes          unique, needing box-line (chute) interactions               */
+/*      tuples          unique, needing naked/hidden subsets                        */
+/*      minimal         unique, and no given can be removed (as sparse as they come */
+/*                      by removing givens, 17 clue puzzles are too rare to find)   */
+/*      multi           more than one solution                                      */
+/*      contradictory   no solution: a digit given twice in a unit, or a changed    */
+/*                      given that only the search finds out                        */
+/*      malformed       fewer than 81 cells, or fewer than 17 givens                */
+/*                                                                                  */
+/* Each puzzle is made from a random solution grid by removing givens in a random   */
+/* order while the puzzle keeps a unique solution and is rated no harder than its   */
+/* class allows (see rate_sudoku()), then altered as the class needs.               */
+/*                                                                                  */
+/* PROGRAM INVOCATION:                                                              */
+/*                                                                                  */
+/*      sudoku_gen [-s seed] [-n count] [-c class=count[,...]] [-o prefix] [-t]     */
+/*                                                                                  */
+/* where:                                                                           */
+/*                                                                                  */
+/*        -c      Sets the number of puzzles of the named classes                   */
+/*        -n      Number of puzzles of every other class (default: 100)             */
+/*        -o      Prefix of the output files (default: corpus)                      */
+/*        -s      Seed of the corpus (default: 1)                                   */
+/*        -t      Write each puzzle as a 9x9 text grid                              */
+/*                                                                                  */
+/* The puzzles of each class are written to <prefix>-<class>.sudoku, one 81         */
+/* character line each as read by sudoku_solver, or to <prefix>-<class>.txt with    */
+/* -t. Each class has its own random sequence, so the same seed gives the same      */
+/* puzzles of a class whatever the sizes of the others.                             */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "sudoku_engine.h"
+
+#define OPTIONS "?c:n:o:s:t"
+
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* Random numbers and a context to solve with, for one class */
+typedef struct gen {
+	uint32_t rand;
+        SOLVER_CTX *ctx;
+} Gen;
+
+static uint32_t gen_rand(Gen *gen)
+{
+	uint32_t x = gen->rand;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        return gen->rand = x;
+}
+
+static void shuffle(Gen *gen, int *a, int n)
+{
+	int i, j, t;
+
+        for (i = n - 1; i > 0; i--) {
+        	j = gen_rand(gen) % (i + 1);
+                t = a[i]; a[i] = a[j]; a[j] = t;
+        }
+}
+
+/* A random order of the cells */
+static void cell_order(Gen *gen, int *order)
+{
+	int i;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) order[i] = i;
+        shuffle(gen, order, PUZZLE_CELLS);
+}
+
+/*****************************************************************/
+/* Fill in a random solution grid. The boxes on the diagonal do  */
+/* not share a unit, so each is given a random permutation, and  */
+/* the solver completes the grid with random branching.          */
+/*****************************************************************/
+
+static void solution_grid(Gen *gen, char *grid)
+{
+	int b, i, perm[PUZZLE_DIM];
+
+        memset(grid, '.', PUZZLE_CELLS);
+        grid[PUZZLE_CELLS] = 0;
+
+        for (b = 0; b < PUZZLE_DIM; b += PUZZLE_ORDER + 1) {
+        	for (i = 0; i < PUZZLE_DIM; i++) perm[i] = i;
+                shuffle(gen, perm, PUZZLE_DIM);
+                for (i = 0; i < PUZZLE_DIM; i++) {
+                	grid[(b / PUZZLE_ORDER * PUZZLE_ORDER + i / PUZZLE_ORDER) * PUZZLE_DIM +
+                             b % PUZZLE_ORDER * PUZZLE_ORDER + i % PUZZLE_ORDER] = '1' + perm[i];
+                }
+        }
+
+        solver_branching(gen->ctx, BRANCH_RANDOM, gen_rand(gen));
+        solver_load(gen->ctx, grid);
+        format_answer(solver_next(gen->ctx), grid);
+}
+
+/* Number of solutions, counting no further than two */
+static int solutions(Gen *gen, const char *puzzle)
+{
+	if (!solver_load(gen->ctx, puzzle)) return 2;	/* too few givens to be unique */
+        if (solver_next(gen->ctx) == NULL) return 0;
+        return solver_next(gen->ctx) == NULL ? 1 : 2;
+}
+
+/* Is the digit in a cell given again in one of its units? */
+static int conflicts(const char *puzzle, int c)
+{
+	int i, r = c / PUZZLE_DIM, k = c % PUZZLE_DIM;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (i == c || puzzle[i] != puzzle[c]) continue;
+                if (i / PUZZLE_DIM == r || i % PUZZLE_DIM == k ||
+                    (i / PUZZLE_DIM / PUZZLE_ORDER == r / PUZZLE_ORDER && i % PUZZLE_DIM / PUZZLE_ORDER == k / PUZZLE_ORDER))
+                	return 1;
+        }
+        return 0;
+}
+
+/* The grade of the hardest rule needed */
+static int rating(const char *puzzle)
+{
+	Solution *s = rate_sudoku(puzzle);
+        int r = s ? s->grid.rating : RATE_TRIAL;
+
+        free_soln_list(s);
+        return r;
+}
+
+/*****************************************************************/
+/* Make a puzzle from a random grid by removing givens in random */
+/* order while it stays unique and no harder than max_rating.    */
+/* A given that cannot be removed never can be later, as fewer   */
+/* givens only allow more solutions, so with no limit on the     */
+/* rating one pass leaves a minimal puzzle. Returns its rating.  */
+/*****************************************************************/
+
+static int dig(Gen *gen, char *puzzle, int max_rating)
+{
+	int i, c, order[PUZZLE_CELLS];
+        char d;
+
+        solution_grid(gen, puzzle);
+        cell_order(gen, order);
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	c = order[i];
+                d = puzzle[c];
+                puzzle[c] = '.';
+                if (solutions(gen, puzzle) != 1 || (max_rating < RATE_TRIAL && rating(puzzle) > max_rating)) {
+                	puzzle[c] = d;
+                }
+        }
+
+        return rating(puzzle);
+}
+
+/* Puzzles as hard as, and no harder than, the given rating */
+static void rated_puzzle(Gen *gen, char *puzzle, int r)
+{
+	while (dig(gen, puzzle, r) != r);
+}
+
+static void make_easy(Gen *gen, char *puzzle)
+{
+	rated_puzzle(gen, puzzle, RATE_SINGLES);
+}
+
+static void make_chutes(Gen *gen, char *puzzle)
+{
+	rated_puzzle(gen, puzzle, RATE_CHUTES);
+}
+
+static void make_tuples(Gen *gen, char *puzzle)
+{
+	rated_puzzle(gen, puzzle, RATE_TUPLES);
+}
+
+static void make_minimal(Gen *gen, char *puzzle)
+{
+	dig(gen, puzzle, RATE_TRIAL);
+}
+
+/* A minimal puzzle less one to three givens, so not unique */
+static void make_multi(Gen *gen, char *puzzle)
+{
+	int i, n, order[PUZZLE_CELLS];
+
+        dig(gen, puzzle, RATE_TRIAL);
+        cell_order(gen, order);
+
+        for (n = 1 + gen_rand(gen) % 3, i = 0; n && i < PUZZLE_CELLS; i++) {
+        	if (puzzle[order[i]] != '.') {
+                	puzzle[order[i]] = '.';
+                        n--;
+                }
+        }
+}
+
+/*****************************************************************/
+/* Either change a given to a digit not given in its units, so   */
+/* that only the search finds there is no solution, or give a    */
+/* digit again in a row or column, which the solver rejects at   */
+/* once.                                                         */
+/*****************************************************************/
+
+static void make_contradictory(Gen *gen, char *puzzle)
+{
+	int i, j, c, p, d, order[PUZZLE_CELLS];
+        char was;
+
+        dig(gen, puzzle, RATE_TRIAL);
+        cell_order(gen, order);
+
+        if (gen_rand(gen) & 1) {
+	        for (i = 0; i < PUZZLE_CELLS; i++) {
+	        	if ((was = puzzle[c = order[i]]) == '.') continue;
+	                for (d = gen_rand(gen) % PUZZLE_DIM, j = 0; j < PUZZLE_DIM; j++) {
+	                	puzzle[c] = '1' + (d + j) % PUZZLE_DIM;
+	                        if (puzzle[c] != was && !conflicts(puzzle, c) && solutions(gen, puzzle) == 0) return;
+	                }
+	                puzzle[c] = was;
+	        }
+        }
+
+        for (i = 0; puzzle[c = order[i]] == '.'; i++);	/* a random given */
+
+        for (j = 0; j < PUZZLE_CELLS; j++) {
+        	p = order[j];
+                if (puzzle[p] == '.' && (p / PUZZLE_DIM == c / PUZZLE_DIM || p % PUZZLE_DIM == c % PUZZLE_DIM)) {
+                	puzzle[p] = puzzle[c];
+                        return;
+                }
+        }
+}
+
+/* Cut a puzzle short, or leave it with fewer than 17 givens */
+static void make_malformed(Gen *gen, char *puzzle)
+{
+	int i, order[PUZZLE_CELLS];
+
+        solution_grid(gen, puzzle);
+        cell_order(gen, order);
+
+        if (gen_rand(gen) & 1) {
+        	for (i = 0; i < PUZZLE_CELLS; i++) {
+                	if (gen_rand(gen) % 3) puzzle[i] = '.';
+                }
+                puzzle[1 + gen_rand(gen) % (PUZZLE_CELLS - 1)] = 0;
+        }
+        else {
+        	for (i = gen_rand(gen) % 17; i < PUZZLE_CELLS; i++) puzzle[order[i]] = '.';
+        }
+}
+
+/* The classes, in the order they are generated */
+static struct corpus_class {
+	const char *name;
+        void (*make)(Gen *gen, char *puzzle);
+        int count;
+} classes[] = {
+	{ "easy", make_easy, -1 },
+        { "chutes", make_chutes, -1 },
+        { "tuples", make_tuples, -1 },
+        { "minimal", make_minimal, -1 },
+        { "multi", make_multi, -1 },
+        { "contradictory", make_contradictory, -1 },
+        { "malformed", make_malformed, -1 }
+};
+
+#define NUM_CLASSES ((int) (sizeof(classes) / sizeof(classes[0])))
+
+/************************************/
+/* Print hints as to command usage. */
+/************************************/
+
+static void usage(char *myname)
+{
+	int k;
+
+	fprintf(stderr, "Usage:\n\t%s [-s seed] [-n count] [-c class=count[,...]] [-o prefix] [-t]\n", myname);
+        fprintf(stderr, "where:\n\t-c\tSets the number of puzzles of the named classes\n"
+                        "\t-n\tNumber of puzzles of every other class (default: 100)\n"
+                        "\t-o\tPrefix of the output files (default: corpus)\n"
+                        "\t-s\tSeed of the corpus (default: 1)\n"
+                        "\t-t\tWrite each puzzle as a 9x9 text grid\n"
+			"\t-?\tPrint usage information\n\n");
+        fprintf(stderr, "The classes are:");
+        for (k = 0; k < NUM_CLASSES; k++) fprintf(stderr, " %s", classes[k].name);
+        fprintf(stderr, "\n");
+}
+
+/* Parse class=count[,...] */
+static int class_counts(char *arg)
+{
+	char *tok, *eq;
+        int k;
+
+        for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        	if ((eq = strchr(tok, '=')) == NULL) return 0;
+                *eq = 0;
+                for (k = 0; k < NUM_CLASSES && strcmp(classes[k].name, tok); k++);
+                if (k == NUM_CLASSES) return 0;
+                classes[k].count = atoi(eq + 1);
+        }
+        return 1;
+}
+
+/*******************/
+/* Mainline logic. */
+/*******************/
+
+int main(int argc, char **argv)
+{
+	int i, k, opt, count, text;
+        unsigned long seed;
+        char *myname, *prefix, path[FILENAME_MAX], puzzle[PUZZLE_CELLS+1];
+        Gen gen;
+        FILE *h;
+
+        myname = argv[0];
+        count = 100;
+        seed = 1;
+        text = 0;
+        prefix = "corpus";
+
+	while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        	switch (opt) {
+                	case 'c':
+                        	if (!class_counts(optarg)) {
+                                	fprintf(stderr, "Bad class count: %s\n", optarg);
+                                        usage(myname);
+                                        exit(1);
+                                }
+                                break;
+                	case 'n':
+                        	count = atoi(optarg);
+                                break;
+                	case 'o':
+                        	prefix = optarg;
+                                break;
+                	case 's':
+                        	seed = strtoul(optarg, NULL, 10);
+                                break;
+                	case 't':
+                        	text = 1;
+                                break;
+                	default:
+                	case '?':
+                        	usage(myname);
+				exit(1);
+                }
+        }
+
+        if (argc > optind) {
+        	usage(myname);
+                exit(1);
+        }
+
+        init_solve_engine(NULL, NULL, NULL, 0, 0);
+        gen.ctx = solver_create();
+
+        for (k = 0; k < NUM_CLASSES; k++) {
+        	if (classes[k].count < 0) classes[k].count = count;
+                if (classes[k].count == 0) continue;
+
+                sprintf(path, "%.*s-%s.%s", FILENAME_MAX - 32, prefix, classes[k].name, text ? "txt" : "sudoku");
+                if (!(h = fopen(path, "w"))) {
+                	fprintf(stderr, "Failed to open corpus file: %s\n", path);
+                        exit(1);
+                }
+
+                /* Each class has a sequence of its own, see above */
+                gen.rand = (uint32_t) ((seed * NUM_CLASSES + k) * 2654435761u) | 1;
+
+                for (i = 0; i < classes[k].count; i++) {
+                	classes[k].make(&gen, puzzle);
+                        if (text && strlen(puzzle) == PUZZLE_CELLS)
+                        	print_grid(puzzle, h);
+                        else
+                        	fprintf(h, "%s\n", puzzle);
+                }
+
+                fclose(h);
+                fprintf(stderr, "%s: %d puzzles\n", path, classes[k].count);
+        }
+
+        solver_destroy(gen.ctx);
+
+        return 0;
+}
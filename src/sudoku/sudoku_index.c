@@ -0,0 +1,447 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_index.c                                                             */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* A sidecar index to a file of puzzles. See sudoku_index.h for the interface and   */
+/* the layout of the file.                                                          */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sudoku_index.h"
+
+#ifdef MMAP_STORE
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef THREADS
+#include <pthread.h>
+#endif
+
+#define INDEX_MAGIC  "SUDIDX01"
+#define MAX_INDEXERS 16
+#define NO_MASK      0xffffffffu	/* pattern of a line too short to hold a puzzle */
+
+/* The head of the file, followed by the offsets, then the patterns */
+typedef struct index_hdr {
+	char magic[8];
+        uint64_t corpus_size;		/* the corpus indexed                     */
+        int64_t corpus_mtime;
+        uint64_t count;			/* puzzles in it                          */
+} IndexHdr;
+
+/* A puzzle's givens pattern. Sorted by pattern, then number. */
+typedef struct index_ent {
+	uint64_t lo;			/* pattern of cells 17-80, one bit each   */
+        uint32_t hi;			/* and of cells 0-16, or NO_MASK          */
+        uint32_t number;		/* of the puzzle, from 1                  */
+} IndexEnt;
+
+struct sudoku_index {
+	int fd, cfd;
+        char *base;			/* the mapping of the index               */
+        size_t size;			/* and its length                         */
+        const char *corpus;		/* the mapping of the corpus              */
+        size_t csize;
+        const IndexHdr *hdr;
+        const uint64_t *offset;		/* of each puzzle in the corpus           */
+        const IndexEnt *ent;
+        unsigned long first;		/* first match of the last index_lookup() */
+};
+
+/* A thread's share of the corpus, in whole lines, and what it finds there */
+typedef struct indexer {
+	const char *corpus, *start, *end;
+        uint64_t *offset;
+        IndexEnt *ent;
+        unsigned long n, max;		/* puzzles found, and room for them       */
+} Indexer;
+
+/* Pack a givens pattern, 27 octal digits. Returns zero if it is not one. */
+static int pack_mask(IndexEnt *e, const char *mask)
+{
+	uint64_t hi = 0, lo = 0;
+	int i;
+
+        for (i = 0; i < PUZZLE_CELLS/3; i++) {
+        	if (mask[i] < '0' || mask[i] > '7') return 0;
+                hi = (hi << 3) | (lo >> 61);
+                lo = (lo << 3) | (mask[i] - '0');
+        }
+        if (mask[i]) return 0;
+
+        e->hi = (uint32_t) hi;
+        e->lo = lo;
+        return 1;
+}
+
+static int compare_mask(const IndexEnt *a, const IndexEnt *b)
+{
+	if (a->hi != b->hi) return a->hi < b->hi ? -1 : 1;
+        if (a->lo != b->lo) return a->lo < b->lo ? -1 : 1;
+        return 0;
+}
+
+static int compare_ent(const void *a, const void *b)
+{
+	const IndexEnt *x = a, *y = b;
+        int rc = compare_mask(x, y);
+
+        return rc ? rc : (x->number > y->number) - (x->number < y->number);
+}
+
+/*****************************************************************/
+/* Index a share of the corpus. Blank lines are skipped, as the  */
+/* solver skips them, so that numbers agree with its own. The    */
+/* share is sorted by pattern here, in parallel; its numbers are */
+/* counted from its start and made whole when merged.            */
+/*****************************************************************/
+
+static void *index_lines(void *arg)
+{
+	Indexer *a = arg;
+        const char *p, *q, *r;
+        char line[PUZZLE_CELLS+1], mbuf[PUZZLE_CELLS/3+1];
+        int len;
+
+        for (p = a->start; p < a->end; p = q + 1) {
+        	if ((q = memchr(p, '\n', a->end - p)) == NULL) q = a->end;
+
+                for (r = p; r < q && *r == '\r'; r++);
+                if (r == q) continue;
+
+                if (a->n == a->max) {
+                	a->max = a->max ? 2 * a->max : 4096;
+                        a->offset = realloc(a->offset, a->max * sizeof(uint64_t));
+                        a->ent = realloc(a->ent, a->max * sizeof(IndexEnt));
+                        if (a->offset == NULL || a->ent == NULL) {
+				fprintf(stderr, "Out of memory.\n");
+				exit(1);
+                        }
+                }
+
+                len = q - p < PUZZLE_CELLS ? q - p : PUZZLE_CELLS;
+                memcpy(line, p, len);
+                line[len] = 0;
+
+                a->offset[a->n] = p - a->corpus;
+                if (!pack_mask(&a->ent[a->n], cvt_to_mask(mbuf, line) ? mbuf : "")) {
+                	a->ent[a->n].hi = NO_MASK;
+                        a->ent[a->n].lo = 0;
+                }
+                a->ent[a->n].number = a->n;
+                a->n++;
+        }
+
+        qsort(a->ent, a->n, sizeof(IndexEnt), compare_ent);
+
+        return NULL;
+}
+
+/* Start of the first whole line at or after a fraction of the corpus */
+static const char *line_boundary(const char *corpus, size_t csize, int i, int threads)
+{
+	const char *p = corpus + (size_t) ((double) csize * i / threads), *q;
+
+        if (i == 0) return corpus;
+        if (i == threads || p[-1] == '\n') return p;
+        q = memchr(p, '\n', corpus + csize - p);
+        return q ? q + 1 : corpus + csize;
+}
+
+/*****************************************************************/
+/* Build the index of a mapped corpus, under a temporary name    */
+/* that is renamed into place once the index is complete.        */
+/*****************************************************************/
+
+static int build_index(const char *path, const char *corpus, size_t csize, const struct stat *cs, int threads)
+{
+	Indexer indexer[MAX_INDEXERS];
+        unsigned long base[MAX_INDEXERS], pos[MAX_INDEXERS], total, n;
+        char tmp[1024], *out;
+        IndexHdr *hdr;
+        uint64_t *offset;
+        IndexEnt *ent;
+        size_t size;
+        int i, k, fd, ok;
+#ifdef THREADS
+	pthread_t tid[MAX_INDEXERS];
+#endif
+
+#ifndef THREADS
+	threads = 1;
+#endif
+        if (threads > MAX_INDEXERS) threads = MAX_INDEXERS;
+        if (threads < 1 || csize < (size_t) threads * 65536) threads = 1;
+
+        memset(indexer, 0, sizeof(indexer));
+        for (i = 0; i < threads; i++) {
+        	indexer[i].corpus = corpus;
+                indexer[i].start = line_boundary(corpus, csize, i, threads);
+                indexer[i].end = line_boundary(corpus, csize, i + 1, threads);
+        }
+
+#ifdef THREADS
+        for (n = 1; n < (unsigned long) threads; n++) {
+        	if (pthread_create(&tid[n], NULL, index_lines, &indexer[n]) != 0) break;
+        }
+        for (i = n; i < threads; i++) index_lines(&indexer[i]);	/* threads that could not be had */
+        index_lines(&indexer[0]);
+        while (--n > 0) pthread_join(tid[n], NULL);
+#else
+        index_lines(&indexer[0]);
+#endif
+
+        for (total = i = 0; i < threads; i++) {
+        	base[i] = total;
+                pos[i] = 0;
+                total += indexer[i].n;
+        }
+
+        ok = 0;
+        fd = -1;
+        out = MAP_FAILED;
+        size = sizeof(IndexHdr) + total * (sizeof(uint64_t) + sizeof(IndexEnt));
+        snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid());
+
+        if (total > 0xffffffffu) errno = EFBIG;
+        else if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0666)) >= 0 && ftruncate(fd, size) == 0 &&
+                 (out = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+
+		hdr = (IndexHdr *) out;
+	        offset = (uint64_t *) (out + sizeof(IndexHdr));
+	        ent = (IndexEnt *) (offset + total);
+
+	        for (i = 0; i < threads; i++)
+	        	memcpy(offset + base[i], indexer[i].offset, indexer[i].n * sizeof(uint64_t));
+
+	        /* Merge the sorted shares. On equal patterns, the earlier share has the lower numbers. */
+	        for (n = 0; n < total; n++) {
+	        	for (k = -1, i = 0; i < threads; i++) {
+	                	if (pos[i] < indexer[i].n &&
+	                            (k < 0 || compare_mask(&indexer[i].ent[pos[i]], &indexer[k].ent[pos[k]]) < 0)) k = i;
+	                }
+	                ent[n] = indexer[k].ent[pos[k]++];
+	                ent[n].number += base[k] + 1;
+	        }
+
+	        /* The magic goes in last */
+	        hdr->corpus_size = csize;
+	        hdr->corpus_mtime = cs->st_mtime;
+	        hdr->count = total;
+	        memcpy(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic));
+
+	        ok = munmap(out, size) == 0 && fsync(fd) == 0;
+        }
+
+        for (i = 0; i < threads; i++) {
+        	free(indexer[i].offset);
+                free(indexer[i].ent);
+        }
+
+        if (fd >= 0) {
+        	if (out == MAP_FAILED) ok = 0;
+                if (close(fd) != 0) ok = 0;
+	        if (ok && rename(tmp, path) != 0) ok = 0;
+	        if (!ok) unlink(tmp);
+        }
+
+        return ok;
+}
+
+/*****************************************************************/
+/* Map an index, and check that it is one. Returns 1 if it is up */
+/* to date with the corpus, -1 if it is out of date, and 0 (with */
+/* errno set) if it cannot be mapped or is not an index.         */
+/*****************************************************************/
+
+static int map_index(SUDOKU_INDEX *ix, const struct stat *cs)
+{
+	struct stat sb;
+        const IndexHdr *h;
+
+        if (fstat(ix->fd, &sb) != 0) return 0;
+        if ((size_t) sb.st_size < sizeof(IndexHdr)) {
+        	errno = EINVAL;
+                return 0;
+        }
+
+        ix->base = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, ix->fd, 0);
+        if (ix->base == MAP_FAILED) {
+        	ix->base = NULL;
+                return 0;
+        }
+        ix->size = sb.st_size;
+
+        h = ix->hdr = (const IndexHdr *) ix->base;
+        if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0 || h->count > 0xffffffffu ||
+            ix->size != sizeof(IndexHdr) + h->count * (sizeof(uint64_t) + sizeof(IndexEnt))) {
+        	errno = EINVAL;
+                return 0;
+        }
+        ix->offset = (const uint64_t *) (ix->base + sizeof(IndexHdr));
+        ix->ent = (const IndexEnt *) (ix->offset + h->count);
+
+        return (h->corpus_size == ix->csize && h->corpus_mtime == (int64_t) cs->st_mtime) ? 1 : -1;
+}
+
+SUDOKU_INDEX *index_open(const char *path, const char *corpus, int threads)
+{
+	SUDOKU_INDEX *ix;
+        struct stat cs;
+        int tries, ok = 0;
+
+	if ((ix = calloc(1, sizeof(SUDOKU_INDEX))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+        ix->fd = -1;
+
+        if ((ix->cfd = open(corpus, O_RDONLY)) < 0 || fstat(ix->cfd, &cs) != 0) {
+        	index_close(ix);
+                return NULL;
+        }
+
+        /* An empty corpus cannot be mapped, and has nothing to map */
+        ix->csize = cs.st_size;
+        if (ix->csize && (ix->corpus = mmap(NULL, ix->csize, PROT_READ, MAP_SHARED, ix->cfd, 0)) == MAP_FAILED) {
+        	ix->corpus = NULL;
+        	index_close(ix);
+                return NULL;
+        }
+
+        /* Use the index if it is up to date, else (re)build it, once */
+        for (tries = 0; !ok && tries < 2; tries++) {
+        	if ((ix->fd = open(path, O_RDONLY)) >= 0) {
+                	if ((ok = map_index(ix, &cs)) == 0) break;
+                        if (ok < 0) {
+                        	munmap(ix->base, ix->size);
+                                ix->base = NULL;
+                                close(ix->fd);
+                                ix->fd = -1;
+                                ok = 0;
+                                errno = ESTALE;
+                        }
+                }
+                else if (errno != ENOENT) break;
+
+                if (!ok && (tries || !build_index(path, ix->corpus, ix->csize, &cs, threads))) break;
+        }
+
+        if (ok <= 0) {
+        	index_close(ix);
+                return NULL;
+        }
+
+        return ix;
+}
+
+unsigned long index_count(const SUDOKU_INDEX *ix)
+{
+	return ix->hdr->count;
+}
+
+int index_puzzle(const SUDOKU_INDEX *ix, unsigned long n, char *buf, int size)
+{
+	const char *p, *q;
+        size_t len;
+
+        if (n < 1 || n > ix->hdr->count) return 0;
+
+        p = ix->corpus + ix->offset[n-1];
+        if ((q = memchr(p, '\n', ix->corpus + ix->csize - p)) == NULL) q = ix->corpus + ix->csize;
+        while (q > p && q[-1] == '\r') q--;
+
+        len = q - p < size - 1 ? (size_t) (q - p) : (size_t) size - 1;
+        memcpy(buf, p, len);
+        buf[len] = 0;
+
+        return 1;
+}
+
+unsigned long index_lookup(SUDOKU_INDEX *ix, const char *mask)
+{
+	IndexEnt key;
+        unsigned long lo, hi, mid, first;
+
+        if (!pack_mask(&key, mask)) return 0;
+
+        /* The first pattern not below the key, then the first above it */
+        for (lo = 0, hi = ix->hdr->count; lo < hi; ) {
+        	mid = lo + (hi - lo) / 2;
+                if (compare_mask(&ix->ent[mid], &key) < 0) lo = mid + 1;
+                else hi = mid;
+        }
+        first = lo;
+        for (hi = ix->hdr->count; lo < hi; ) {
+        	mid = lo + (hi - lo) / 2;
+                if (compare_mask(&ix->ent[mid], &key) <= 0) lo = mid + 1;
+                else hi = mid;
+        }
+
+        ix->first = first;
+        return lo - first;
+}
+
+unsigned long index_match(const SUDOKU_INDEX *ix, unsigned long i)
+{
+	return ix->ent[ix->first + i].number;
+}
+
+void index_close(SUDOKU_INDEX *ix)
+{
+	if (ix->base) munmap(ix->base, ix->size);
+        if (ix->corpus) munmap((void *) ix->corpus, ix->csize);
+        if (ix->fd >= 0) close(ix->fd);
+        if (ix->cfd >= 0) close(ix->cfd);
+        free(ix);
+}
+
+#else
+
+SUDOKU_INDEX *index_open(const char *path, const char *corpus, int threads)
+{
+	errno = ENOSYS;
+        return NULL;
+}
+
+unsigned long index_count(const SUDOKU_INDEX *ix)
+{
+	return 0;
+}
+
+int index_puzzle(const SUDOKU_INDEX *ix, unsigned long n, char *buf, int size)
+{
+	return 0;
+}
+
+unsigned long index_lookup(SUDOKU_INDEX *ix, const char *mask)
+{
+	return 0;
+}
+
+unsigned long index_match(const SUDOKU_INDEX *ix, unsigned long i)
+{
+	return 0;
+}
+
+void index_close(SUDOKU_INDEX *ix)
+{
+}
+
+#endif
@@ -0,0 +1,76 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_index.h                                                             */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* A sidecar index to a puzzle file (a corpus), so that chosen puzzles can be read  */
+/* from it without reading the rest. Puzzles are numbered from 1 as the solver      */
+/* numbers them, i.e. skipping blank lines, and are found either by number or by    */
+/* the pattern of their givens, as printed by cvt_to_mask().                        */
+/*                                                                                  */
+/* The index file holds the size and modification time of the corpus it was built  */
+/* from, the offset of each puzzle in the corpus, and the puzzles' givens patterns  */
+/* in sorted order. It is built in one pass over the memory mapped corpus, split    */
+/* between threads when built with -DTHREADS, and written under a temporary name    */
+/* and renamed, so a reader never sees it part written. An index that no longer     */
+/* matches its corpus is rebuilt when opened.                                       */
+/*                                                                                  */
+/* Like the store (sudoku_store.h), the index needs mmap(), so it is only built     */
+/* when MMAP_STORE is defined. Otherwise index_open() always fails (with errno set  */
+/* to ENOSYS.)                                                                      */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#ifndef _SUDINDEX_H_
+
+#define _SUDINDEX_H_
+
+#include "sudoku_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opaque handle on an open index and its corpus */
+typedef struct sudoku_index SUDOKU_INDEX;
+
+/*****************************************************************/
+/* index_open() opens the index of a corpus, building it (with   */
+/* up to the given number of threads) if the index file does not */
+/* exist or is out of date. It returns NULL, with errno set, if  */
+/* either file cannot be opened, or the index file exists but is */
+/* not an index. A corpus may hold up to 2^32-1 puzzles.         */
+/*                                                               */
+/* index_count() returns the number of puzzles in the corpus.    */
+/*                                                               */
+/* index_puzzle() copies puzzle n (1 based), less its line       */
+/* ending, into buf, cut short to fit if need be. It returns     */
+/* zero if there is no such puzzle.                              */
+/*                                                               */
+/* index_lookup() finds the puzzles whose givens have the given  */
+/* pattern, 27 octal digits as from cvt_to_mask(), and returns   */
+/* how many there are. index_match() then returns the number of  */
+/* the i'th of them (0 based), in ascending order.               */
+/*                                                               */
+/* index_close() releases the handle.                            */
+/*****************************************************************/
+
+SUDOKU_INDEX *index_open(const char *path, const char *corpus, int threads);
+unsigned long index_count(const SUDOKU_INDEX *ix);
+int index_puzzle(const SUDOKU_INDEX *ix, unsigned long n, char *buf, int size);
+unsigned long index_lookup(SUDOKU_INDEX *ix, const char *mask);
+unsigned long index_match(const SUDOKU_INDEX *ix, unsigned long i);
+void index_close(SUDOKU_INDEX *ix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,857 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_rules.h                                                             */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* The deductive rules of the solver engine: markup, singletons, chutes, subsets,   */
+/* uniqueness and probing, with the simple solver that loops over the first two.    */
+/* This is not a public header. sudoku_engine.c includes it once with the           */
+/* EXPLAIN_* hooks compiled out for the plain kernels, (when EXPLAIN is defined)    */
+/* once with them compiled in for the explaining kernels, and once with             */
+/* RULES_LAYOUT set for the kernels of the variant layouts, the last two under      */
+/* other names. See the kernels table in sudoku_engine.c.                           */
+/*                                                                                  */
+/* The classic kernels read the units and peers from the fixed tables, so loop      */
+/* bounds and table addresses are known at compile time. The layout kernels read    */
+/* them from the tables that init_solve_engine() builds for the chosen layout,      */
+/* and leave out the rules that depend on the classic arrangement of boxes          */
+/* (chutes, unique rectangles and BUG+1), see set_layout().                         */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#undef PEER_COUNT
+#undef PEER_LIST
+#undef UNIT_BOX
+#undef EXTRA_UNITS
+#undef UNIT_EXTRA
+
+#if RULES_LAYOUT
+#define PEER_COUNT(c)	layout.npeers[c]
+#define PEER_LIST(c)	layout.peers[c]
+#define UNIT_BOX(i)	layout.unit[2 * PUZZLE_DIM + (i)]
+#define EXTRA_UNITS	(layout.units - 3 * PUZZLE_DIM)
+#define UNIT_EXTRA(i)	layout.unit[3 * PUZZLE_DIM + (i)]
+#else
+#define PEER_COUNT(c)	PEER_LEN
+#define PEER_LIST(c)	peers[c]
+#define UNIT_BOX(i)	box[i]
+#define EXTRA_UNITS	0
+#define UNIT_EXTRA(i)	box[i]
+#endif
+
+/********************************************************************************/
+/* This function uses the cells with unique values, i.e. the given              */
+/* or subsequently discovered solution values, to eliminate said values         */
+/* as candidates in other as yet unsolved cells in the associated               */
+/* rows, columns, and 3x3 boxes.                                                */
+/*                                                                              */
+/* The function has three possible return values:                               */
+/*   NOCHANGE - Markup did not change during the last pass,                     */
+/*   CHANGE   - Markup was modified, and                                        */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values */
+/********************************************************************************/
+
+static int mark_cells(Grid *g)
+{
+        int i, chgflag, bc, ndx;
+        short elt, mask, before, cell;
+
+       	chgflag = NOCHANGE;
+
+	while (g->tail < g->exposed) {
+
+		elt = g->solved[g->tail++];
+
+                mask = ~g->cell[elt];
+
+                for (i = 0; i < PEER_COUNT(elt); i++) {
+
+                	/* Get the cell value to change */
+                        ndx = PEER_LIST(elt)[i];
+                        before = cell = g->cell[ndx];
+
+                        /* Eliminate this candidate value whilst preserving other candidate values */
+                        cell &= mask;
+			g->cell[ndx] = cell;
+
+                        /* Did the cell change value? */
+                	if (before != cell) {
+
+				chgflag |= CHANGE;	/* Flag that puzzle markup was changed */
+                                g->score += g->inc;	/* More work means higher scoring      */
+
+                                if (!(bc = bitcount(cell))) {
+                                	EXPLAIN_MARKUP_IMPASSE(g, ndx, elt);
+					return IMPASSE;	/* Crap out if no candidates remain */
+                                }
+
+                                EXPLAIN_MARKUP_ELIM(g, ndx, elt);
+
+                                /* Check if we solved for this cell, i.e. bit count indicates a unique value */
+                                if (bc == 1) {
+					MARK_SOLVED(g, ndx);		/* Mark cell as found  */
+                                        g->score += g->reward;		/* Add to puzzle score */
+					g->pass_mods += 1;
+                                        g->solved[g->exposed++] = ndx;
+                                	EXPLAIN_MARKUP_SOLVE(g, ndx);
+                                }
+			}
+                }
+        }
+
+        return chgflag;
+}
+
+
+/*******************************************************************/
+/* Identify and "solve" all cells that, by reason of their markup, */
+/* can only assume one specific value, i.e. the cell is the only   */
+/* one in a row/column/box (specified by vector) that is           */
+/* able to assume a particular value.                              */
+/*                                                                 */
+/* The function has two possible return values:                    */
+/*   NOCHANGE - Markup did not change during the last pass,        */
+/*   CHANGE   - Markup was modified.                               */
+/*******************************************************************/
+
+static int find_singletons(Grid *g, uint8_t const *vector, char *vdesc)
+{
+	int i, j, mask, hist[PUZZLE_DIM], value[PUZZLE_DIM], found = NOCHANGE;
+
+	/* We are going to create a histogram of cell candidate values */
+        /* for the specified cell vector (row/column/box).             */
+        /* First set all buckets to zero.                              */
+        memset(hist, 0, sizeof(hist[0])*PUZZLE_DIM);
+
+	/* For each possible candidate value... */
+	for (mask = 1, i = 0; i < PUZZLE_DIM; i++) {
+
+	        /* For each cell in the vector... */
+        	for (j = 0; j < PUZZLE_DIM; j++) {
+
+                	/* If the cell may possibly assume this value... */
+        		if (g->cell[vector[j]] & mask) {
+
+                        	if (++hist[i] > 1) break;		/* Bump bucket in histogram */
+                		value[i] = vector[j];			/* Save the cell coordinate */
+                	}
+                }
+
+                mask <<= 1;
+        }
+
+        /* Examine each bucket in the histogram... */
+        for (mask = 1, i = 0; i < PUZZLE_DIM; i++) {
+
+        	/* If the bucket == 1 and the cell is not already solved,  */
+		/* then the cell has a unique solution specified by "mask" */
+        	if (hist[i] == 1 && !IS_SOLVED(g, value[i])) {
+
+                	found = CHANGE;			 /* Indicate that markup has been changed */
+                        g->cell[value[i]] = mask;	 /* Assign solution value to cell         */
+                        MARK_SOLVED(g, value[i]);	 /* Mark cell as solved                   */
+                        g->score += g->reward;           /* Bump puzzle score                     */
+                        g->pass_mods += 1;
+                        g->solved[g->exposed++] = value[i];
+                        EXPLAIN_SINGLETON(g, value[i], mask, vdesc);
+                }
+
+                mask <<= 1;		/* Get next candidate value */
+        }
+
+	return found;
+}
+
+
+/*******************************************************************/
+/* Find all cells with unique solutions (according to markup)      */
+/* and mark them as found. Do this for each row, column, and       */
+/* box.                                                            */
+/*                                                                 */
+/* The function has two possible return values:                    */
+/*   NOCHANGE - Markup did not change during the last pass,        */
+/*   CHANGE   - Markup was modified.                               */
+/*******************************************************************/
+
+static int eliminate_singles(Grid *g)
+{
+	int i, found = NOCHANGE;
+
+        /* Do rows (horizontal chutes) */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	found |= find_singletons(g, row[i], "row");
+        }
+
+        /* Do columns (vertical chutes) */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	found |= find_singletons(g, col[i], "column");
+        }
+
+        /* Do boxes */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	found |= find_singletons(g, UNIT_BOX(i), "box");
+        }
+
+        /* Do any extra units of the layout */
+        for (i = 0; i < EXTRA_UNITS; i++) {
+        	found |= find_singletons(g, UNIT_EXTRA(i), "unit");
+        }
+
+        return found;
+}
+
+/********************************************************************************/
+/* Solves simple puzzles, i.e. single elimination                               */
+/*                                                                              */
+/* The function has three possible return values:                               */
+/*   NOCHANGE - Markup did not change during the last pass,                     */
+/*   CHANGE   - Markup was modified, and                                        */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values */
+/********************************************************************************/
+static int simple_solver(Grid *g)
+{
+	int i, b, flag, rc = NOCHANGE;
+
+        /* Mark the unsolved cells with candidate solutions based upon the current set of "givens" and solved cells */
+        for (i = 0;; i++) {
+
+	        g->pass_mods = 0;	/* Count number of solved cells per iteration */
+
+        	if ((flag = mark_cells(g)) == IMPASSE) return flag;
+
+                rc |= flag;
+
+        	g->inc = 1;	     /* After initial markup, we start scoring for additional markup work */
+
+        	if (flag == CHANGE) EXPLAIN_CURRENT_MARKUP(g);
+
+		/* Continue to eliminate cells with unique candidate solutions from the game until */
+        	/* elimination and repeated markup efforts produce no changes in the remaining     */
+	        /* candidate solutions.                                                            */
+                if (eliminate_singles(g) == NOCHANGE)
+			break;
+
+                /* score penalty for puzzle bottlenecks */
+		if (g->pass_mods < 4) {
+                        b = 1 + (20 * (PUZZLE_CELLS - g->exposed - g->pass_mods)) / (g->exposed * (g->pass_mods + 1));
+                        g->score += b;
+        	}
+
+                EXPLAIN_CURRENT_MARKUP(g);
+        }
+
+        /* score penalty for puzzle bottlenecks */
+	if (i == 0 && g->pass_mods < 4 && g->exposed < PUZZLE_CELLS) {
+                b = 1 + (20 * (PUZZLE_CELLS - g->exposed - g->pass_mods)) / (g->exposed * (g->pass_mods + 1));
+                g->score += b;
+        }
+
+        /* Any cell solved beyond the givens required at least the singles rules */
+        if (g->exposed > g->givens) bump_rating(g, RATE_SINGLES);
+
+        return rc;
+}
+
+
+#if !RULES_LAYOUT
+/************************************************************************************/
+/* Test rows and columns of box arrays to see if the candidates for a particular    */
+/* number are confined to the same N rows or columns for the same set of N boxes,   */
+/* and if so, eliminate their occurences in the remainder of the rows and/or        */
+/* columns of the boxes not members of the aforementioned set of boxes.             */
+/* (Hint: Think pointing pairs, etc.)                                               */
+/*                                                                                  */
+/* The function has three possible return values:                                   */
+/*   NOCHANGE - Markup did not change during the last pass,                         */
+/*   CHANGE   - Markup was modified, and                                            */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values     */
+/************************************************************************************/
+
+static int box_row_chute_elim(Grid *g, int num)
+{
+        int i, j, k, b, c, mask, box_tuple, box_row_mask, t, rc;
+        short cell, boxmask[PUZZLE_DIM];
+
+        /* Init */
+        rc = NOCHANGE;
+
+        mask = 1 << num;
+
+	/* Compute the mask value for the box that has a 1 bit in       */
+        /* positions corresponding to the row containing the candidate. */
+        for (i = 0; i < PUZZLE_DIM; i++) {    /* for each box, do... */
+        	boxmask[i] = 0;
+        	for (j = 0; j < PUZZLE_DIM; j++) {	/* for each cell in the box do... */
+        		c = box[i][j];
+        		if (!IS_SOLVED(g, c) && (g->cell[c] & mask)) {
+                        	boxmask[i] |= 1 << map[c].row;
+                	}
+        	}
+        }
+
+	mask = ~mask;
+
+	/* Figure out, for each row of boxes, if the candidate number lies in N rows for a subset of N boxes */
+        /* where N is in the range [1..PUZZLE_ORDER-1].  If so, eliminate the candidate number from boxes    */
+        /* in that row of boxes which are not contained within the subset.                                   */
+
+        for (i = 1; i < PUZZLE_ORDER; i++) {					/* for each subset... */
+
+        	for (b = 0; b < PUZZLE_DIM; b += PUZZLE_ORDER) {		/* for each of the rows of boxes... */
+
+                	box_tuple = box_row_mask = 0;
+
+                	for (k = 0; k < PUZZLE_ORDER; k++) {			/* for each box within the row... */
+
+				if (bitcount(boxmask[b+k]) == i) {		/* does the box belong to the subset? */
+
+                                	box_tuple = 1 << (b+k);			/* include box in subset */
+                                        box_row_mask = boxmask[b+k];
+
+                                	if (i - 1) for (t = 0; t < PUZZLE_ORDER; t++) {	/* find other boxes in the subset, if any */
+
+                                        	if (t != k && box_row_mask == boxmask[b+t]) {	/* did we find one? */
+                                                	box_tuple |= 1 << (b+t);
+                                                }
+                                        }
+                        	}
+                        }
+
+                        /* Did we meet N row and N box constraint for this row of boxes? */
+                        if (bitcount(box_tuple) == i) for (k = b; k < b+PUZZLE_ORDER; k++) {
+
+                        	if ((box_tuple & (1 << k)) == 0) {	/* If box k is not in subset... */
+
+                                	for (t = 0; t < PUZZLE_DIM; t++) {
+
+                                        	c = box[k][t];
+                                                cell = g->cell[c];
+
+                                                /* Is box cell in the desired row? */
+                                                /* And is it unsolved?             */
+                                                if (((1 << map[c].row) & box_row_mask) &&       
+                                                   !IS_SOLVED(g, c)) {
+                                                	if ((g->cell[c] &= mask) == 0) {
+								EXPLAIN_VECTOR_IMPASSE(g, "row", box_row_mask, c, num, box_tuple);
+								g->score += 10;
+								return IMPASSE;
+                                                        }
+                                                        if (g->cell[c] ^ cell) {
+                                                                boxmask[k] &= ~(1 << map[c].row);
+                                                        	rc = CHANGE;
+                                                                g->pass_mods += 1;
+                                                                g->score += bitcount(g->cell[c] ^ cell);
+			                                        EXPLAIN_VECTOR_ELIM("row", box_row_mask, c, num, box_tuple);
+                                                                if (bitcount(g->cell[c]) == 1) {
+                                                                	MARK_SOLVED(g, c);
+                                                                        g->score += g->reward + 5;
+                                                                        g->solved[g->exposed++] = c;
+                                                                        EXPLAIN_VECTOR_SOLVE(g, c);
+                                                                        return CHANGE;
+                                                                }
+                                                        }
+                                                }
+                                        }
+                                }
+                        }
+                }
+        }
+
+        if (rc == CHANGE) {
+		g->score += 5;	/* Bump score for sucessfully invoking this rule */
+        }
+
+        return rc;
+}
+
+/*************/
+/* As above. */
+/*************/
+
+static int box_col_chute_elim(Grid *g, int num)
+{
+        int i, j, k, b, c, mask, box_tuple, box_col_mask, t, rc;
+        short cell, boxmask[PUZZLE_DIM];
+
+        /* Init */
+        rc = NOCHANGE;
+
+        mask = 1 << num;
+
+	/* Compute the mask value for the box that has a 1 bit in          */
+        /* positions corresponding to the column containing the candidate. */
+        for (i = 0; i < PUZZLE_DIM; i++) {    /* for each box, do... */
+        	boxmask[i] = 0;
+        	for (j = 0; j < PUZZLE_DIM; j++) {	/* for each cell in the box do... */
+        		c = box[i][j];
+        		if (!IS_SOLVED(g, c) && (g->cell[c] & mask)) {
+                        	boxmask[i] |= 1 << map[c].col;
+                	}
+        	}
+        }
+
+	mask = ~mask;
+
+	/* Figure out, for each column of boxes, if the candidate number lies in N columns for a subset of N boxes */
+        /* where N is in the range [1..PUZZLE_ORDER-1].  If so, eliminate the candidate number from boxes          */
+        /* in those column of boxes which are not contained within the subset.                                     */
+
+        for (i = 1; i < PUZZLE_ORDER; i++) {					/* for each subset... */
+
+        	for (b = 0; b < PUZZLE_ORDER; b++) {				/* for each of the columns of boxes... */
+
+                	box_tuple = box_col_mask = 0;
+
+                	for (k = 0; k < PUZZLE_DIM; k += PUZZLE_ORDER) {	/* for each box within the column... */
+
+				if (bitcount(boxmask[b+k]) == i) {		/* does the box belong to the subset? */
+
+                                	box_tuple = 1 << (b+k);			/* include box in subset */
+                                        box_col_mask = boxmask[b+k];
+
+                                	if (i - 1) for (t = 0; t < PUZZLE_DIM; t += PUZZLE_ORDER) { /* find other boxes in the subset, if any */
+
+                                        	if (t != k && box_col_mask == boxmask[b+t]) {	/* did we find one? */
+                                                	box_tuple |= 1 << (b+t);
+                                                }
+                                        }
+                        	}
+                        }
+
+                        /* Did we meet N column and N box constraint for this column of boxes? */
+                        if (bitcount(box_tuple) == i) for (k = b; k < PUZZLE_DIM; k += PUZZLE_ORDER) {
+
+                        	if ((box_tuple & (1 << k)) == 0) {	/* If box k is not in subset... */
+
+                                	for (t = 0; t < PUZZLE_DIM; t++) {
+
+                                        	c = box[k][t];
+                                                cell = g->cell[c];
+
+                                                /* Is box cell in the desired column? */
+                                                /* And is it unsolved?                */
+                                                if (((1 << map[c].col) & box_col_mask) &&       
+                                                   !IS_SOLVED(g, c)) {
+                                                	if ((g->cell[c] &= mask) == 0) {
+								EXPLAIN_VECTOR_IMPASSE(g, "column", box_col_mask, c, num, box_tuple);
+								g->score += 10;
+								return IMPASSE;
+                                                        }
+                                                        if (g->cell[c] ^ cell) {
+                                                                boxmask[k] &= ~(1 << map[c].col);
+                                                        	rc = CHANGE;
+                                                                g->pass_mods += 1;
+                                                                g->score += bitcount(g->cell[c] ^ cell);
+			                                        EXPLAIN_VECTOR_ELIM("column", box_col_mask, c, num, box_tuple);
+                                                                if (bitcount(g->cell[c]) == 1) {
+                                                                	MARK_SOLVED(g, c);
+                                                                        g->score += g->reward + 5;
+                                                                        g->solved[g->exposed++] = c;
+                                                                        EXPLAIN_VECTOR_SOLVE(g, c);
+                                                                        return CHANGE;
+                                                                }
+                                                        }
+                                                }
+                                        }
+                                }
+                        }
+                }
+        }
+
+        if (rc == CHANGE) {
+		g->score += 5;	/* Bump score for sucessfully invoking this rule */
+        }
+
+        return rc;
+}
+
+/**********************************************************************************/
+/* Test all boxes to see if the possibilities for a number                        */
+/* are confined to specific row or column chutes, and if so, eliminate            */
+/* the occurence of candidate solutions from the remainder of the                 */
+/* specified row or column.                                                       */
+/*                                                                                */
+/* The function has three possible return values:                                 */
+/*   NOCHANGE - Markup did not change during the last pass,                       */
+/*   CHANGE   - Markup was modified, and                                          */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
+/**********************************************************************************/
+
+static int chute_elimination(Grid *g)
+{
+	int i, rc;
+
+        rc = NOCHANGE;
+        g->pass_mods = 0;
+
+	/* For each digit... */
+	for (i = 0; i < PUZZLE_DIM && rc == NOCHANGE; i++) {
+		rc |= box_row_chute_elim(g, i);
+        }        
+
+	if (rc == NOCHANGE) for (i = 0; i < PUZZLE_DIM && rc == NOCHANGE; i++) {
+		rc |= box_col_chute_elim(g, i);
+        }
+
+        /* score penalty for puzzle bottlenecks */
+	if (g->pass_mods && g->pass_mods < 3) {
+                g->score += 15 - (5 * g->pass_mods);;
+        }
+
+        return rc;
+}
+#endif
+
+
+/**********************************************************************************/
+/* This function implements the rule that when a subset of cells                  */
+/* in a row/column/box contain matching tuples of candidate                       */
+/* solutions, i.e. 2 matching candidates for 2 cells, 3 matching                  */
+/* candidate possibilities for 3 cells, etc., then those                          */
+/* candidate tuples may be eliminated from the other cells in the                 */
+/* row, column, or box.                                                           */
+/*                                                                                */
+/* The function has three possible return values:                                 */
+/*   NOCHANGE - Markup did not change during the last pass,                       */
+/*   CHANGE   - Markup was modified, and                                          */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
+/**********************************************************************************/
+
+static int elim_naked_tuples(Grid *g, uint8_t const *cell_list, char *desc, int ndx)
+{
+	int i, j, k, c, rc, flag, tuple_count, cellset, iter;
+	const int *tuple_list;
+        short m, mask, totalmask, tmp;
+
+        rc = NOCHANGE;
+
+	/* Compute bitmap of all possible candidates for this list of unsolved cells. */
+        for (j = totalmask = 0; j < PUZZLE_DIM; j++) {
+        	if (!IS_SOLVED(g, cell_list[j]))
+                	totalmask |= g->cell[cell_list[j]];
+        }
+
+        iter = bitcount(totalmask);
+
+        /* Check for two thru N valued naked tuples */
+        for (i = 2; i < iter; i++) {
+
+        	flag = NOCHANGE;
+                tuple_list = tuples_list[i].tuple_list;
+                tuple_count = tuples_list[i].tuple_count;
+
+                for (j = 0; j < tuple_count && i < iter; j++) {
+
+                	mask = tuple_list[j];
+
+                	/* prune tuple search space */
+                	if ((mask & totalmask) != mask) continue;
+
+			/* Look for all unsolved cells containing this tuple */
+                        for (m = 1, cellset = k = 0; k < PUZZLE_DIM; m <<= 1, k++) {
+	                	c = cell_list[k];
+        	                if (!IS_SOLVED(g, c) && (g->cell[c] & mask) == g->cell[c])
+                                	cellset |= m;
+                        }
+
+			/* Did we find a naked tuple? */
+                        if ((m = bitcount(cellset)) == i) {
+
+                                mask = ~mask;
+                                totalmask &= mask;
+                                iter = bitcount(totalmask);
+
+                                for (m = 1, k = 0; k < PUZZLE_DIM; k++, m <<= 1) {
+
+        		                if (m & cellset) continue;	/* skip cells within tuple set */
+
+		                	c = cell_list[k];
+					if (IS_SOLVED(g, c)) continue;	/* only consider unsolved cells */
+
+                                        /* Get cell candidates */
+                                        tmp = g->cell[c];
+
+                                        /* Eliminate tuple values from cell candidates */
+                                        g->cell[c] &= mask;
+
+                                        /* Did the elimination change the candidates? */
+                                        if (tmp ^ g->cell[c]) {
+
+                                                /* Note the change and bump the score */
+						flag = CHANGE;
+                                                g->pass_mods += 1;
+		                                g->score += bitcount(tmp ^ g->cell[c]);
+
+                                                EXPLAIN_TUPLE_ELIM(desc, ndx, ~mask, c);
+
+                                                /* Did we solve the cell under consideration? */
+                        	        	if (bitcount(g->cell[c]) == 1) {
+
+                                                	/* Mark cell as found and bump the score */
+                                        		MARK_SOLVED(g, c);
+                		                        g->score += g->reward;
+                                                        g->solved[g->exposed++] = c;
+                                                        EXPLAIN_TUPLE_SOLVE(g, c);
+	        	                        }
+        	                        }
+                                }
+                        }
+			else if (m > i) {
+                		EXPLAIN_TUPLE_IMPASSE(g, desc, ndx, cellset, m, i);
+                        	g->score += 10;
+				return IMPASSE;
+                	}
+                }
+                
+                if (flag == CHANGE)
+			g->score += 10 + 2 *(5 - abs(5 - i));
+
+                rc |= flag;
+        }
+
+	return rc;
+}
+
+
+/**********************************************************************************/
+/* Eliminate subsets from rows, columns, and boxes.                               */
+/*                                                                                */
+/* The function has three possible return values:                                 */
+/*   NOCHANGE - Markup did not change during the last pass,                       */
+/*   CHANGE   - Markup was modified, and                                          */
+/*   IMPASSE  - Markup results are invalid, i.e. a cell has no candidate values   */
+/**********************************************************************************/
+ 
+static int naked_tuple_elimination(Grid *g)
+{
+	int i, rc = NOCHANGE;
+
+        g->pass_mods = 0;
+
+        /* Eliminate subsets from rows */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	rc |= elim_naked_tuples(g, row[i], "row", i);
+        }
+
+        /* Eliminate subsets from columns */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	rc |= elim_naked_tuples(g, col[i], "column", i);
+        }
+
+        /* Eliminate subsets from boxes */
+        for (i = 0; i < PUZZLE_DIM; i++) {
+        	rc |= elim_naked_tuples(g, UNIT_BOX(i), "box", i);
+        }
+
+        /* Eliminate subsets from any extra units of the layout */
+        for (i = 0; i < EXTRA_UNITS; i++) {
+        	rc |= elim_naked_tuples(g, UNIT_EXTRA(i), "unit", i);
+        }
+
+        /* score penalty for puzzle bottlenecks */
+	if (g->pass_mods && g->pass_mods < 4) {
+                g->score += 20 - (5 * g->pass_mods);;
+        }
+
+        return rc;
+}
+
+#if !RULES_LAYOUT
+/**********************************************************************************/
+/* Deductions that only hold if the puzzle has a unique solution.                 */
+/*                                                                                */
+/* Unique rectangle: four unsolved cells at the corners of a rectangle that spans */
+/* two rows, two columns and two boxes. If three of them hold just the same pair  */
+/* of candidates, the fourth may not be reduced to that pair too, or the two      */
+/* digits could be swapped around the rectangle to give a second solution. So the */
+/* pair is removed from the fourth cell, and if all four already hold just the    */
+/* pair, the markup is at an impasse.                                             */
+/*                                                                                */
+/* BUG+1 (bivalue universal grave): if every unsolved cell but one has two        */
+/* candidates, the odd one has three, and each candidate appears twice in every   */
+/* unit but for one digit that appears three times in the units of the odd cell,  */
+/* then that digit solves the odd cell. Otherwise the puzzle would be left in a   */
+/* state that has either no solution or more than one.                            */
+/*                                                                                */
+/* The function has three possible return values:                                 */
+/*   NOCHANGE - Markup did not change during the last pass,                       */
+/*   CHANGE   - Markup was modified, and                                          */
+/*   IMPASSE  - Markup results are invalid, i.e. the solution is not unique       */
+/**********************************************************************************/
+
+static int unique_elimination(Grid *g)
+{
+	int a, b, c, d, i, j, m, bc, extra, hist[PUZZLE_DIM];
+        uint8_t const *unit;
+
+        /* Look for rectangles from the corner diagonally opposite the one to be reduced */
+        for (a = 0; a < PUZZLE_CELLS; a++) {
+
+        	if (bitcount(m = g->cell[a]) != 2) continue;
+
+                for (i = 0; i < PUZZLE_DIM; i++) {
+
+                	if ((b = row[map[a].row][i]) == a || g->cell[b] != m) continue;
+
+                        for (j = 0; j < PUZZLE_DIM; j++) {
+
+                        	if ((c = col[map[a].col][j]) == a || g->cell[c] != m) continue;
+
+                                /* The rectangle must span exactly two boxes */
+                                if ((map[a].box == map[b].box) == (map[a].box == map[c].box)) continue;
+
+                                d = row[map[c].row][map[b].col];
+
+                                if (g->cell[d] == m) {
+                                	EXPLAIN_UNIQUE_IMPASSE(g, a, d, m);
+                                        return IMPASSE;
+                                }
+
+                                if ((g->cell[d] & m) != m) continue;
+
+                                g->cell[d] &= ~m;
+                                g->score += 10;
+                                EXPLAIN_UNIQUE_ELIM(a, b, c, d, m);
+
+                                if (bitcount(g->cell[d]) == 1) {
+                                	MARK_SOLVED(g, d);
+                                        g->score += g->reward;
+                                        g->solved[g->exposed++] = d;
+                                        EXPLAIN_UNIQUE_SOLVE(g, d);
+                                }
+
+                                return CHANGE;
+                        }
+                }
+        }
+
+        /* BUG+1: find the one unsolved cell that does not have two candidates */
+        for (extra = -1, i = 0; i < PUZZLE_CELLS; i++) {
+        	if (IS_SOLVED(g, i) || (bc = bitcount(g->cell[i])) == 2) continue;
+                if (bc != 3 || extra >= 0) return NOCHANGE;
+                extra = i;
+        }
+
+        if (extra < 0) return NOCHANGE;
+
+        /* Every candidate must appear twice per unit, bar the odd cell's digit */
+        for (m = 0, i = 0; i < 3 * PUZZLE_DIM; i++) {
+
+        	unit = i < PUZZLE_DIM ? row[i] : i < 2 * PUZZLE_DIM ? col[i - PUZZLE_DIM] : box[i - 2 * PUZZLE_DIM];
+                memset(hist, 0, sizeof(hist));
+
+                for (j = 0; j < PUZZLE_DIM; j++) {
+                	c = unit[j];
+                	if (IS_SOLVED(g, c)) continue;
+                        for (d = 0; d < PUZZLE_DIM; d++) {
+                        	if (g->cell[c] & (1 << d)) hist[d] += 1;
+                        }
+                }
+
+                for (d = 0; d < PUZZLE_DIM; d++) {
+                	if (hist[d] == 0 || hist[d] == 2) continue;
+                        if (hist[d] != 3 || (m && m != (1 << d))) return NOCHANGE;
+                        m = 1 << d;
+                }
+        }
+
+        if (!(g->cell[extra] & m)) return NOCHANGE;
+
+        g->cell[extra] = m;
+        MARK_SOLVED(g, extra);
+        g->score += g->reward + 10;
+        g->solved[g->exposed++] = extra;
+        EXPLAIN_BUG(g, extra);
+
+        return CHANGE;
+}
+#endif
+
+/**********************************************************************************/
+/* Failed literal probing. Each value of a bivalue cell is assigned in turn to a  */
+/* copy of the puzzle, and only the cheap rules (markup and singles) are applied. */
+/* A value that leads straight to an impasse is removed. Failing that, any        */
+/* candidate that both values remove from a cell is removed from the puzzle too,  */
+/* which includes any cell that both values solve the same way. At most          */
+/* PROBE_CELLS cells are probed per call, and the first change found is kept.    */
+/*                                                                                */
+/* The function has three possible return values:                                 */
+/*   NOCHANGE - Markup did not change during the last pass,                       */
+/*   CHANGE   - Markup was modified, and                                          */
+/*   IMPASSE  - Markup results are invalid, i.e. both values of a cell fail       */
+/**********************************************************************************/
+
+#define PROBE_CELLS 16
+
+/* Assign a value to a cell in a copy of the puzzle, and apply the simple solver to it */
+static int probe_value(const Grid *g, Grid *t, int c, int mask)
+{
+        memcpy(t, g, sizeof(Grid));
+        t->cell[c] = mask;
+        MARK_SOLVED(t, c);
+        t->solved[t->exposed++] = c;
+#if EXPLAIN_HOOKS
+        return simple_solver_plain(t);	/* the probe is not part of the solution */
+#else
+        return simple_solver(t);
+#endif
+}
+
+static int probe_elimination(Grid *g)
+{
+	Grid t[2];
+	int c, i, m, f0, f1, n, rc = NOCHANGE;
+
+        for (n = 0, c = 0; c < PUZZLE_CELLS && n < PROBE_CELLS; c++) {
+
+        	if (IS_SOLVED(g, c) || bitcount(m = g->cell[c]) != 2) continue;
+                n += 1;
+
+                f0 = probe_value(g, &t[0], c, m & -m);		/* the lower value */
+                f1 = probe_value(g, &t[1], c, m & (m - 1));	/* the higher one  */
+
+                if (f0 == IMPASSE && f1 == IMPASSE) {
+                	EXPLAIN_PROBE_IMPASSE(g, c);
+                        return IMPASSE;
+                }
+
+                if (f0 == IMPASSE || f1 == IMPASSE) {
+                	i = f0 == IMPASSE ? 0 : 1;
+                        EXPLAIN_PROBE_ELIM(c, t[i].cell[c]);
+                        g->cell[c] = t[1-i].cell[c];
+                        MARK_SOLVED(g, c);
+                        g->score += g->reward;
+                        g->solved[g->exposed++] = c;
+                        EXPLAIN_PROBE_SOLVE(g, c);
+                        return CHANGE;
+                }
+
+                /* Keep only the candidates that one value or the other leaves */
+                for (i = 0; i < PUZZLE_CELLS; i++) {
+
+                	if (IS_SOLVED(g, i) || (m = g->cell[i] & ~(t[0].cell[i] | t[1].cell[i])) == 0) continue;
+
+                        EXPLAIN_PROBE_AGREE(c, i, m);
+                        g->cell[i] &= ~m;
+                        rc = CHANGE;
+
+                        if (bitcount(g->cell[i]) == 1) {
+                        	MARK_SOLVED(g, i);
+                                g->score += g->reward;
+                                g->solved[g->exposed++] = i;
+                                EXPLAIN_PROBE_SOLVE(g, i);
+                        }
+                }
+
+                if (rc == CHANGE) return rc;
+        }
+
+        return rc;
+}
@@ -26,26 +26,67 @@
 /* usage:                                                                           */
 /*                                                                                  */
 /*      sudoku_solver {-p puzzle | -f <puzzle_file>} [-o <outfile>]                 */
-/*              [-r <reject_file>] [-1][-a][-c][-d][-g][-m][-n][-s]                 */
+/*              [-r <reject_file>] [-1][-A][-a][-C][-c][-d][-e][-G][-g][-L][-l][-M] */
+/*              [-m][-n][-R][-s][-U][-V] [-N <max_nodes>] [-T <max_msecs>]          */
+/*              [-H <kbytes>] [-S <store_file>] [-B <min_score>[,<max_score>]]      */
+/*              [-D <min_depth>[,<max_depth>]] [-w <capture_file>]                  */
+/*              [-W <usecs>[,<nodes>]] [-k <index_file> [-K <list>]]                */
+/*              [-Y x | windoku | <jigsaw_regions>] [-P <threads>]                  */
 /*                                                                                  */
 /* where:                                                                           */
 /*                                                                                  */
 /*        -1      Search for first solution, otherwise all solutions are returned   */
+/*        -A      Order the deductive rules by their observed payoff                */
 /*        -a      Requests that the answer (solution) be printed                    */
+/*        -B      Print only the puzzles with a unique solution and a               */
+/*                score in this band                                                */
+/*        -C      Check submitted solutions, each following its puzzle,             */
+/*                instead of solving                                                */
 /*        -c      Print a count of solutions for each puzzle                        */
+/*        -D      As -B, for the trial-and-error depth (1 for none)                 */
 /*        -d      Print the recursive trial depth required to solve the puzzle      */
 /*        -e      Print a step-by-step explanation of the solution(s)               */
-/*        -f      Takes an argument which specifes an input file                    */
-/*                containing one or more unsolved puzzles (default: stdin)          */
+/*                (EXPLAIN builds only)                                             */
+/*        -f      Takes an argument which specifes an input file containing one or  */
+/*                more unsolved puzzles, one per line ('-' for stdin)               */
 /*        -G      Print the puzzle solution(s) in a 9x9 grid format                 */
 /*        -g      Print the number of given clues                                   */
+/*        -H      Only count solutions, using a transposition table                 */
+/*                of this many KB                                                   */
+/*        -K      Solve only these puzzles of the -k index: numbers, ranges (m-n)   */
+/*                and octal givens masks, separated by commas                       */
+/*        -k      Read the -f puzzle file through this index, building it           */
+/*                if need be                                                        */
+/*        -L      Probe cells with two candidates before each                       */
+/*                trial-and-error level                                             */
+/*        -l      Print a histogram of the time taken by each puzzle                */
+/*                with the summary                                                  */
+/*        -M      Find the redundant givens of each puzzle, and a minimal           */
+/*                subset of them                                                    */
 /*        -m      Print an octal mask for the puzzle givens                         */
+/*        -N      Give up on a puzzle after this many trial-and-error levels        */
 /*        -n      Number each result                                                */
 /*        -o      Specifies an output file for the solutions (default: stdout)      */
+/*        -P      Race this many branching heuristics on each puzzle, one per       */
+/*                thread (implies -1), or with -M, test this many givens at once    */
+/*                (THREADS builds only)                                             */
 /*        -p      Takes an argument giving a single inline puzzle to be solved      */
 /*        -r      Specifies an output file for unsolvable puzzles                   */
 /*                (default: stderr)                                                 */
+/*        -R      Rate the puzzle by the hardest deductive rule needed to solve it  */
+/*                (implies -1)                                                      */
+/*        -S      Look puzzles up in, and add their unique solutions to, this       */
+/*                store (MMAP_STORE builds only)                                    */
 /*        -s      Print the puzzle's score or difficulty rating                     */
+/*        -T      Give up on a puzzle after this many milliseconds                  */
+/*        -U      Assume each puzzle has a unique solution                          */
+/*                (unique rectangles, BUG+1)                                        */
+/*        -V      As -U, but check the result with a plain search                   */
+/*        -w      Append slow puzzles, with their stats, to this capture file       */
+/*        -W      A puzzle is slow from this many usecs, or trial-and-error levels  */
+/*                (default 10000,10000)                                             */
+/*        -Y      Solve X-sudoku (x), windoku, or jigsaw puzzles whose boxes are    */
+/*                given as 81 digits 1-9, the box of each cell                      */
 /*        -?      Print usage information                                           */
 /*                                                                                  */
 /* The return code is zero if all puzzles had unique solutions,                     */
@@ -96,16 +137,26 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <time.h>
 
 #include "sudoku_engine.h"
+#include "sudoku_store.h"
+#include "sudoku_index.h"
 
 #define VERSION "1.20"
 
 /* Command line options */
+#ifdef THREADS
+#define THREAD_OPTIONS "P:"
+#else
+#define THREAD_OPTIONS ""
+#endif
+
 #ifdef EXPLAIN
-#define OPTIONS "?1acde:Ggmnp:s"
+#define OPTIONS "?1AaB:CcD:de:f:GgH:K:k:lLMmN:np:RS:sT:UVw:W:Y:" THREAD_OPTIONS
 #else
-#define OPTIONS "?1acd:Ggmnp:s"
+#define OPTIONS "?1AaB:CcD:d:f:GgH:K:k:lLMmN:np:RS:sT:UVw:W:Y:" THREAD_OPTIONS
 #endif
 
 extern char *optarg;
@@ -118,38 +169,395 @@ extern int optind, opterr, optopt;
 static void usage(char *myname)
 {
 	fprintf(stderr, "Usage:\n\t%s {-p puzzle | -f <puzzle_file>} [-o <outfile>]\n", myname);
-        fprintf(stderr, "\t\t[-r <reject_file>] [-1][-a][-c][-G][-g][-l][-m][-n][-s]\n");
+        fprintf(stderr, "\t\t[-r <reject_file>] [-1][-A][-a][-C][-c][-G][-g][-L][-l][-M][-m][-n][-R][-s][-U][-V]\n");
+        fprintf(stderr, "\t\t[-N <max_nodes>] [-T <max_msecs>] [-H <kbytes>] [-S <store_file>]\n");
+        fprintf(stderr, "\t\t[-B <min_score>[,<max_score>]] [-D <min_depth>[,<max_depth>]]\n");
+        fprintf(stderr, "\t\t[-w <capture_file>] [-W <usecs>[,<nodes>]] [-k <index_file> [-K <list>]]\n");
+        fprintf(stderr, "\t\t[-Y x | windoku | <jigsaw_regions>]\n");
+#ifdef THREADS
+        fprintf(stderr, "\t\t[-P <threads>]\n");
+#endif
         fprintf(stderr, "where:\n\t-1\tSearch for first solution, otherwise all solutions are returned\n"
+                        "\t-A\tOrder the deductive rules by their observed payoff\n"
                         "\t-a\tRequests that the answer (solution) be printed\n"
+                        "\t-B\tPrint only the puzzles with a unique solution and a score in this band\n"
+                        "\t-C\tCheck submitted solutions, each following its puzzle, instead of solving\n"
                         "\t-c\tPrint a count of solutions for each puzzle\n"
+                        "\t-D\tAs -B, for the trial-and-error depth (1 for none)\n"
                         "\t-d\tPrint the recursive trial depth required to solve the puzzle\n"
 #ifdef EXPLAIN
 			"\t-e\tPrint a step-by-step explanation of the solution(s)\n"
 #endif
+                        "\t-f\tTakes an argument which specifies an input file of puzzles, one per line ('-' for stdin)\n"
                         "\t-G\tPrint the puzzle solution(s) in a 9x9 grid format\n"
                         "\t-g\tPrint the number of given clues\n"
+                        "\t-H\tOnly count solutions, using a transposition table of this many KB\n"
+                        "\t-K\tSolve only these puzzles of the -k index: numbers, ranges (m-n)\n"
+                        "\t\tand octal givens masks, separated by commas\n"
+                        "\t-k\tRead the -f puzzle file through this index, building it if need be\n"
+                        "\t-L\tProbe cells with two candidates before each trial-and-error level\n"
+                        "\t-l\tPrint a histogram of the time taken by each puzzle with the summary\n"
+                        "\t-M\tFind the redundant givens of each puzzle, and a minimal subset of them\n"
                         "\t-m\tPrint an octal mask for the puzzle givens\n"
+                        "\t-N\tGive up on a puzzle after this many trial-and-error levels\n"
                         "\t-n\tNumber each result\n"
+#ifdef THREADS
+                        "\t-P\tRace this many branching heuristics on each puzzle, one per thread (implies -1),\n"
+                        "\t\tor with -M, test this many givens at once\n"
+#endif
                         "\t-p\tTakes an argument giving a single inline puzzle to be solved\n"
+                        "\t-R\tRate the puzzle by the hardest deductive rule needed (implies -1)\n"
+                        "\t-S\tLook puzzles up in, and add their unique solutions to, this store\n"
                         "\t-s\tPrint the puzzle's score or difficulty rating\n"
+                        "\t-T\tGive up on a puzzle after this many milliseconds\n"
+                        "\t-U\tAssume each puzzle has a unique solution (unique rectangles, BUG+1)\n"
+                        "\t-V\tAs -U, but check the result with a plain search\n"
+                        "\t-w\tAppend slow puzzles, with their stats, to this capture file\n"
+                        "\t-W\tA puzzle is slow from this many usecs, or trial-and-error levels\n"
+                        "\t\t(default 10000,10000)\n"
+                        "\t-Y\tSolve X-sudoku (x), windoku, or jigsaw puzzles whose boxes are given as\n"
+                        "\t\t81 digits 1-9, the box of each cell\n"
 			"\t-?\tPrint usage information\n\n");
         fprintf(stderr, "The return code is zero if all puzzles had unique solutions,\n"
                         "(or have one or more solutions when -1 is specified) and non-zero\n"
                         "when no unique solution exists.\n");
 }
 
+/*****************************************************************/
+/* Latency histogram of the puzzles solved (-l), kept HDR style: */
+/* exact below 16 usecs, then 16 buckets to each power of two,   */
+/* so every latency is held to within 1/16th of its value in a   */
+/* small, fixed table.                                           */
+/*****************************************************************/
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((int) (sizeof(unsigned long) * CHAR_BIT - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct histogram {
+	unsigned long count[HIST_BUCKETS];
+        unsigned long n, min, max;
+        double sum;
+} Histogram;
+
+/* Return a microsecond clock, as the engine's millisecond one */
+static unsigned long clock_usecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        	return (unsigned long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+	return (unsigned long) ((double) clock() * 1000000 / CLOCKS_PER_SEC);
+}
+
+static int hist_bucket(unsigned long v)
+{
+	int e;
+
+        if (v < HIST_SUB) return (int) v;
+        for (e = HIST_SUB_BITS; v >> (e + 1); e++);
+        return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int) ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* The least value held by a bucket */
+static unsigned long hist_value(int b)
+{
+	int e;
+
+        if (b < HIST_SUB) return b;
+        e = b / HIST_SUB + HIST_SUB_BITS - 1;
+        return (unsigned long) (HIST_SUB + b % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+static void hist_record(Histogram *hist, unsigned long v)
+{
+	if (hist->n == 0 || v < hist->min) hist->min = v;
+        if (v > hist->max) hist->max = v;
+	hist->count[hist_bucket(v)] += 1;
+        hist->sum += v;
+        hist->n += 1;
+}
+
+/* The latency that a fraction q of the puzzles did not exceed, to the bucket */
+static unsigned long hist_quantile(const Histogram *hist, double q)
+{
+	unsigned long seen = 0;
+        int b;
+
+        for (b = 0; b < HIST_BUCKETS - 1; b++) {
+        	if ((seen += hist->count[b]) >= q * hist->n) break;
+        }
+        return (b < HIST_BUCKETS - 1 && hist_value(b + 1) - 1 < hist->max) ? hist_value(b + 1) - 1 : hist->max;
+}
+
+/* Print the percentiles, then the counts to each power of two */
+static void hist_print(const Histogram *hist, FILE *h)
+{
+	static const double pct[] = { 50, 90, 99, 99.9, 99.99 };
+	unsigned long seen, lim;
+        int b, i;
+
+        if (hist->n == 0) return;
+
+        fprintf(h, "Latency (usecs): min: %lu", hist->min);
+        for (i = 0; i < (int) (sizeof(pct) / sizeof(pct[0])); i++) {
+        	fprintf(h, ", p%g: %lu", pct[i], hist_quantile(hist, pct[i] / 100));
+        }
+        fprintf(h, ", max: %lu, mean: %.1f\n", hist->max, hist->sum / hist->n);
+
+        for (seen = 0, b = 0; b < HIST_BUCKETS && seen < hist->n;) {
+        	lim = hist_value(b) ? 2 * hist_value(b) : 1;
+                do {
+                        seen += hist->count[b++];
+                } while (b < HIST_BUCKETS && hist_value(b) < lim);
+                if (seen) fprintf(h, "\t< %-10lu %10lu  %6.2f%%\n", lim, seen, 100.0 * seen / hist->n);
+        }
+}
+
+/*****************************************************************/
+/* Append a slow puzzle to the capture file (-w), with how long  */
+/* it took and what the search did, as a corpus to tune against. */
+/*****************************************************************/
+
+static void capture_puzzle(FILE *h, const char *puzzle, unsigned long usecs, const SOLVE_STATS *stats)
+{
+	static const char *rule_names[NUM_RULES] = { "chutes", "tuples", "unique", "probe" };
+        int r;
+
+        fprintf(h, "%*.*s usecs: %lu nodes: %lu score: %u depth: %d count: %u status: %d",
+        	PUZZLE_CELLS, PUZZLE_CELLS, puzzle, usecs, stats->nodes, stats->score, stats->maxlvl, stats->solncount, stats->status);
+        for (r = 0; r < NUM_RULES; r++) {
+        	fprintf(h, " %s: %lu/%lu/%lu", rule_names[r], stats->rule[r].calls, stats->rule[r].hits, stats->rule[r].skips);
+        }
+        fprintf(h, "\n");
+        fflush(h);
+}
+
+/*****************************************************************/
+/* Read the next non-blank line of a puzzle file, less its line  */
+/* ending. The rest of an overlong line is dropped. Returns zero */
+/* at the end of the file.                                       */
+/*****************************************************************/
+
+static int read_puzzle(FILE *h, char *buf, int size)
+{
+	int c, n;
+
+        do {
+	        if (fgets(buf, size, h) == NULL) return 0;
+                n = strlen(buf);
+                if (n && buf[n-1] != '\n') {
+                	while ((c = getc(h)) != EOF && c != '\n');
+                }
+                while (n && (buf[n-1] == '\n' || buf[n-1] == '\r')) buf[--n] = 0;
+        } while (n == 0);
+
+        return 1;
+}
+
+/*****************************************************************/
+/* Puzzles chosen from an indexed puzzle file (-k, -K), from a   */
+/* comma separated list of puzzle numbers, ranges of them (m-n,  */
+/* or m- to the end) and givens masks (27 octal digits, as -m    */
+/* prints them), taken in the order listed. Without a list every */
+/* puzzle is taken. Returns zero when the list is done.          */
+/*****************************************************************/
+
+/* Processors online, to build an index with */
+static int ncpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        return n > 0 ? (int) n : 1;
+#else
+	return 1;
+#endif
+}
+
+typedef struct selection {
+	SUDOKU_INDEX *ix;
+        const char *next;		/* the rest of the list                  */
+        unsigned long cur, end;		/* puzzles, or matches, still to come    */
+        int by_mask;
+} Selection;
+
+static int select_puzzle(Selection *sel, char *buf, int size, unsigned long *number, FILE *rejects)
+{
+	char item[64], *e;
+        unsigned long n, count = index_count(sel->ix);
+        size_t len;
+
+        for (;;) {
+        	while (sel->cur < sel->end) {
+                	n = sel->by_mask ? index_match(sel->ix, sel->cur) : sel->cur;
+                        sel->cur++;
+                        if (index_puzzle(sel->ix, n, buf, size)) {
+                        	*number = n;
+                                return 1;
+                        }
+                	fprintf(rejects, "%lu: no such puzzle\n", n);
+                }
+
+                if (sel->next == NULL || *sel->next == 0) return 0;
+
+                len = strcspn(sel->next, ",");
+                snprintf(item, sizeof(item), "%.*s", (int) len, sel->next);
+                sel->next += len + (sel->next[len] == ',');
+
+                if (len == PUZZLE_CELLS/3 && strspn(item, "01234567") == len) {
+                	sel->by_mask = 1;
+                        sel->cur = 0;
+                        if ((sel->end = index_lookup(sel->ix, item)) == 0)
+                        	fprintf(rejects, "%s: no puzzles with this mask\n", item);
+                }
+                else {
+                	sel->by_mask = 0;
+                	sel->cur = strtoul(item, &e, 10);
+                        sel->end = sel->cur + 1;
+                        if (e != item && *e == '-') {
+                        	sel->end = *++e ? strtoul(e, &e, 10) + 1 : count + 1;
+                                if (sel->end > count + 1) sel->end = count + 1;
+                        }
+                        if (e == item || *e || sel->cur == 0) {
+                        	fprintf(rejects, "%s: not a puzzle number, range or mask\n", item);
+                                sel->end = 0;
+                        }
+                }
+        }
+}
+
+/*****************************************************************/
+/* Check submitted solutions rather than solve (-C.) Each line   */
+/* holds a puzzle, then its submitted solution, optionally after */
+/* blanks or punctuation. Lines are checked a batch at a time,   */
+/* and each failure is reported with its first error. Returns    */
+/* non-zero if any submission is not a valid solution.           */
+/*****************************************************************/
+
+#define CHECK_BATCH 1024
+
+static int check_submissions(FILE *h, const char *inbuf, FILE *solnfile, FILE *rejects, int prt_num)
+{
+	static char lines[CHECK_BATCH][2*PUZZLE_CELLS + 64];
+        static const char *puzzles[CHECK_BATCH], *answers[CHECK_BATCH];
+        static CHECK_RESULT res[CHECK_BATCH];
+	static const char *unit_names[] = { "", "row", "column", "box", "extra unit" };
+        unsigned long count, valid;
+        size_t i, n;
+        const char *a;
+        int c;
+
+        count = valid = 0;
+
+        do {
+        	/* Fill a batch, from the -p argument or the file */
+        	for (n = 0; n < CHECK_BATCH; n++) {
+                	if (*inbuf && count == 0 && n == 0) {
+                        	snprintf(lines[n], sizeof(lines[n]), "%s", inbuf);
+                        }
+                	else if (!h || !read_puzzle(h, lines[n], sizeof(lines[n]))) break;
+
+                        puzzles[n] = a = lines[n];
+                        if (strlen(a) > PUZZLE_CELLS) {
+                        	for (a += PUZZLE_CELLS; *a && strchr(" \t,;:|", *a); a++);
+                        }
+                        else a = "";
+                        answers[n] = a;
+                }
+
+                valid += check_solutions(puzzles, answers, n, res);
+
+                for (i = 0; i < n; i++) {
+                	if (res[i].status == CHECK_OK) {
+                        	if (prt_num) fprintf(solnfile, "%lu: ok\n", count + i + 1);
+                                continue;
+                        }
+                        c = res[i].cell;
+                	fprintf(rejects, "%lu: %s ", count + i + 1, answers[i]);
+                        switch (res[i].status) {
+                        	case CHECK_BADFORMAT:
+                                	if (c < 0 || answers[i][c] == 0)
+                                        	fprintf(rejects, "is incomplete\n");
+                                        else
+	                                	fprintf(rejects, "has no digit at row %d, col %d\n", 1 + c/PUZZLE_DIM, 1 + c%PUZZLE_DIM);
+                                        break;
+                        	case CHECK_GIVEN:
+                                	fprintf(rejects, "changes the given at row %d, col %d\n", 1 + c/PUZZLE_DIM, 1 + c%PUZZLE_DIM);
+                                        break;
+                                default:
+                                	fprintf(rejects, "repeats %c in %s %d at row %d, col %d\n", answers[i][c],
+                                        	unit_names[res[i].unit_type], 1 + res[i].unit, 1 + c/PUZZLE_DIM, 1 + c%PUZZLE_DIM);
+                                        break;
+                        }
+                }
+
+                count += n;
+        } while (n == CHECK_BATCH);
+
+	fprintf(solnfile, "\nSubmissions: %lu, Valid: %lu, Invalid: %lu\n", count, valid, count - valid);
+
+        return valid != count;
+}
+
+/*****************************************************************/
+/* Make up a solution list from a store entry, as solve_sudoku() */
+/* would have returned it.                                       */
+/*****************************************************************/
+
+static Solution *stored_soln(const STORE_ENTRY *e, const char *puzzle)
+{
+	Solution *s;
+        int i;
+
+	if ((s = calloc(1, sizeof(Solution))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	s->grid.cell[i] = 1 << (e->answer[i] - '1');
+                s->grid.solvedmap[i / 32] |= 1u << (i % 32);
+                if (puzzle[i] >= '1' && puzzle[i] <= '9') {
+                	s->grid.givenmap[i / 32] |= 1u << (i % 32);
+                	s->grid.givens += 1;
+                }
+        }
+        s->grid.exposed = PUZZLE_CELLS;
+        s->grid.solncount = e->solncount;
+        s->grid.score = e->score;
+        s->grid.maxlvl = e->maxlvl;
+        s->grid.rating = e->rating;
+
+        return s;
+}
+
 /*******************/
 /* Mainline logic. */
 /*******************/
 
 int main(int argc, char **argv)
 {
-	int i, rc, bogus, opt, count, solved, unsolved, solncount, explain, first_soln_only;
-        int prt_count, prt_num, prt_score, prt_answer, prt_depth, prt_grid, prt_mask, prt_givens, prt;
-        char *myname, outbuf[128], mbuf[28];
+	int i, rc, bogus, opt, count, solved, unsolved, timedout, solncount, explain, first_soln_only, schedule, threads, unique, probe, check, analyze, band, matched, min_depth;
+        int prt_count, prt_num, prt_score, prt_answer, prt_depth, prt_grid, prt_mask, prt_givens, prt_rating, prt_latency, prt, layout;
+        unsigned long number;
+        char *myname, *infile, *store_path, *capture_path, *index_path, *regions, *p, outbuf[128], mbuf[28];
         static char inbuf[1024];
-	Grid *s, *g, *solved_list;
-        FILE *solnfile, *rejects;
+	Solution *s, *solved_list;
+        Grid *g;
+        SOLVER_CTX *counter;
+        SUDOKU_STORE *store;
+        Selection sel;
+        STORE_ENTRY entry;
+        unsigned int store_mode;
+        unsigned long tt_kbytes, start, usecs, slow_usecs, slow_nodes, min_score;
+        static Histogram hist;
+        SOLVE_LIMITS limits;
+        SOLVE_STATS stats;
+        CLUE_REPORT report;
+        FILE *h, *solnfile, *rejects, *capture;
 
         /* Get our command name from invoking command line */
         myname = argv[0];
@@ -158,11 +566,33 @@ int main(int argc, char **argv)
         fprintf(stderr, "%s version %s\n", myname, VERSION);
 
         /* Init */
+        h = NULL;
         solnfile = stdout;
         rejects = stderr;
-        count = solved = unsolved = 0;
-        explain = rc = bogus = prt_mask = prt_grid = prt_score = prt_depth = prt_answer = prt_count = prt_num = prt_givens = 0;
+        infile = NULL;
+        capture = NULL;
+        capture_path = NULL;
+        slow_usecs = slow_nodes = 10000;
+        prt_latency = 0;
+        count = number = solved = unsolved = timedout = 0;
+        explain = rc = bogus = prt_mask = prt_grid = prt_score = prt_depth = prt_answer = prt_count = prt_num = prt_givens = prt_rating = 0;
         first_soln_only = 0;
+        schedule = SCHED_STATIC;
+        tt_kbytes = 0;
+        threads = 1;
+        unique = UNIQUE_OFF;
+        probe = 0;
+        check = analyze = 0;
+        band = matched = min_depth = 0;
+        layout = LAYOUT_CLASSIC;
+        regions = NULL;
+        min_score = 0;
+        counter = NULL;
+        store = NULL;
+        store_path = NULL;
+        index_path = NULL;
+        memset(&sel, 0, sizeof(sel));
+        memset(&limits, 0, sizeof(limits));
         *inbuf = 0;
 
         /* Parse command line options */
@@ -171,12 +601,28 @@ int main(int argc, char **argv)
                         case '1':
                         	first_soln_only = 1;		/* only find first soln */
                                 break;
+                        case 'A':
+                        	schedule = SCHED_ADAPTIVE;	/* adaptive rule order */
+                                break;
                         case 'a':
                         	prt_answer = 1;		/* print solution */
                                 break;
+                        case 'B':
+                        	band = 1;
+                        	min_score = strtoul(optarg, &p, 10);
+                                if (*p == ',') limits.max_score = strtoul(p + 1, NULL, 10);
+                                break;
+                        case 'C':
+                        	check = 1;		/* check, don't solve */
+                                break;
                         case 'c':
                         	prt_count = 1;		/* number solutions */
                                 break;
+                        case 'D':
+                        	band = 1;
+                        	min_depth = atoi(optarg);
+                                if ((p = strchr(optarg, ',')) != NULL) limits.max_depth = atoi(p + 1);
+                                break;
                         case 'd':
                         	prt_depth = 1;
                                 break;
@@ -185,24 +631,95 @@ int main(int argc, char **argv)
                         	explain = 1;
                                 break;
 #endif
+                	case 'f':
+                        	if (*inbuf) {		/* -p and -f options are mutually exclusive */
+                                	fprintf(stderr, "The -p and -f options are mutually exclusive\n");
+                                	usage(myname);
+                                        exit(1);
+                                }
+                        	infile = optarg;	/* get name of input file */
+                                break;
                         case 'G':
                         	prt_grid = 1;
                                 break;
                         case 'g':
                         	prt_givens = 1;
                                 break;
+                        case 'H':
+                        	tt_kbytes = strtoul(optarg, NULL, 10);
+                                break;
+                        case 'K':
+                        	sel.next = optarg;
+                                break;
+                        case 'k':
+                        	index_path = optarg;
+                                break;
+                        case 'L':
+                        	probe = 1;
+                                break;
+                        case 'l':
+                        	prt_latency = 1;
+                                break;
+                        case 'M':
+                        	analyze = 1;
+                                break;
                         case 'm':
                         	prt_mask = 1;
                                 break;
+                        case 'N':
+                        	limits.max_nodes = strtoul(optarg, NULL, 10);
+                                break;
                         case 'n':
                         	prt_num = 1;
                                 break;
+#ifdef THREADS
+                        case 'P':
+                        	threads = atoi(optarg);
+                                if (threads > 1) first_soln_only = 1;	/* the race is for the first soln */
+                                break;
+#endif
                 	case 'p':
+                        	if (infile) {
+                                	fprintf(stderr, "The -p and -f options are mutually exclusive\n");
+                                	usage(myname);
+                                        exit(1);
+                                }
                                 strncpy(inbuf, optarg, sizeof(inbuf)-1);
                                 break;
+                        case 'R':
+                        	prt_rating = 1;
+                        	first_soln_only = 1;	/* rating stops at first soln */
+                                break;
+                        case 'S':
+                        	store_path = optarg;
+                                break;
                         case 's':
                         	prt_score = 1;
                                 break;
+                        case 'T':
+                        	limits.max_msecs = strtoul(optarg, NULL, 10);
+                                break;
+                        case 'U':
+                        	unique = UNIQUE_ASSUME;
+                                break;
+                        case 'V':
+                        	unique = UNIQUE_VERIFY;
+                                break;
+                        case 'w':
+                        	capture_path = optarg;
+                                break;
+                        case 'W':
+                        	slow_usecs = strtoul(optarg, &p, 10);
+                                if (*p == ',') slow_nodes = strtoul(p + 1, NULL, 10);
+                                break;
+                        case 'Y':
+                        	if (!strcmp(optarg, "x")) layout = LAYOUT_X;
+                                else if (!strcmp(optarg, "windoku")) layout = LAYOUT_WINDOKU;
+                                else {
+                                	layout = LAYOUT_JIGSAW;
+                                        regions = optarg;
+                                }
+                                break;
                 	default:
                 	case '?':
                         	usage(myname);
@@ -211,7 +728,7 @@ int main(int argc, char **argv)
         }
 
         /* Set prt flag if we're printing anything at all */
-	prt = prt_mask | prt_grid | prt_score | prt_depth | prt_answer | prt_num | prt_givens;
+	prt = prt_mask | prt_grid | prt_score | prt_depth | prt_answer | prt_num | prt_givens | prt_rating;
 
         /* Anything else on the command line is bogus */
         if (argc > optind) {
@@ -228,35 +745,255 @@ int main(int argc, char **argv)
         	fprintf(stderr, "Scoring is meaningless when multi-solution mode is disabled.\n");
         }
 
+        /* An indexed puzzle file is mapped rather than read */
+        if (index_path) {
+        	if (!infile || !strcmp(infile, "-") || check) {
+                	fprintf(stderr, "The -k option needs a puzzle file (-f), and cannot be used with -C\n");
+                	usage(myname);
+                        exit(1);
+                }
+                if ((sel.ix = index_open(index_path, infile, ncpus())) == NULL) {
+                	fprintf(stderr, "Cannot open index %s of %s: %s\n", index_path, infile, strerror(errno));
+                        exit(1);
+                }
+                if (sel.next == NULL) {
+                	sel.cur = 1;
+                        sel.end = index_count(sel.ix) + 1;
+                }
+        }
+        else if (sel.next) {
+        	fprintf(stderr, "The -K option needs an index (-k)\n");
+                usage(myname);
+                exit(1);
+        }
+	else if (infile && strcmp(infile, "-") && !(h = fopen(infile, "r"))) {
+        	fprintf(stderr, "Failed to open input game file: %s\n", infile);
+		exit(1);
+        }
+        else if (infile && !h) h = stdin;
+
+        if (capture_path && !(capture = fopen(capture_path, "a"))) {
+                fprintf(stderr, "Failed to open capture file: %s\n", capture_path);
+		exit(1);
+        }
+
+        if (!set_layout(layout, regions)) {
+        	fprintf(stderr, "Jigsaw regions must be 81 digits 1-9, each used nine times\n");
+                exit(1);
+        }
+        if (layout != LAYOUT_CLASSIC && explain) {
+        	fprintf(stderr, "Explanations are only given for classic puzzles\n");
+        }
+        if (layout == LAYOUT_JIGSAW && store_path) {
+        	fprintf(stderr, "The -S option cannot be used with jigsaw puzzles\n");
+                exit(1);
+        }
+
         init_solve_engine(NULL, solnfile, rejects, first_soln_only, explain);
 
-        while (*inbuf) {
+        if (check) return check_submissions(h, inbuf, solnfile, rejects, prt_num);
+        set_solve_limits(&limits);
+        set_rule_schedule(schedule);
+        set_uniqueness(unique);
+        set_probing(probe);
+
+        if (tt_kbytes) {
+        	counter = solver_create();
+                solver_ttable(counter, tt_kbytes * 1024);
+        }
+
+        /* Results differ with the settings, so they are stored under a tag for them */
+        store_mode = first_soln_only | prt_rating << 1 | unique << 2 | probe << 4 | schedule << 5 | (threads > 1) << 6 | layout << 7;
+
+        if (store_path && !explain && (store = store_open(store_path, 1)) == NULL) {
+        	fprintf(stderr, "Cannot open store %s: %s\n", store_path, strerror(errno));
+                exit(1);
+        }
+
+        while (*inbuf || (sel.ix ? select_puzzle(&sel, inbuf, sizeof(inbuf), &number, rejects) : h && read_puzzle(h, inbuf, sizeof(inbuf)))) {
 
 		count += 1;
+                if (!sel.ix) number = count;
+                start = clock_usecs();
+
+                /* Analyze the givens only */
+                if (analyze) {
+                	switch (analyze_clues(inbuf, threads, &report)) {
+                        	case SOLVE_OK:
+                                	solved++;
+                                        if (prt_num) fprintf(solnfile, "%lu: ", number);
+                                        fprintf(solnfile, "givens: %d redundant: %d", report.givens, report.redundant);
+                                        if (report.redundant) {
+                                        	for (i = 0; i < PUZZLE_CELLS; i++) {
+                                                	if (report.clue[i] == CLUE_REDUNDANT)
+                                                        	fprintf(solnfile, " r%dc%d=%c", 1 + i/PUZZLE_DIM, 1 + i%PUZZLE_DIM, inbuf[i]);
+                                                }
+                                        }
+                                        fprintf(solnfile, " minimal: %d %s", report.minimal, report.subset);
+                                        if (prt_mask) fprintf(solnfile, " %s", cvt_to_mask(mbuf, report.subset));
+                                        fprintf(solnfile, "\n");
+                                        break;
+                                case SOLVE_TIMEOUT:
+                                case SOLVE_CANCELLED:
+                                	timedout++;
+                                        rc |= 1;
+	                		fprintf(rejects, "%lu: %*.*s timed out\n", number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+                                        break;
+                                case SOLVE_NOTUNIQUE:
+                                	unsolved++;
+                                        rc |= 1;
+	                		fprintf(rejects, "%lu: %*.*s is not unique\n", number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+                                        break;
+                                case SOLVE_NOSOLUTION:
+                                case SOLVE_CONTRADICTION:
+                                	unsolved++;
+                                        rc |= 1;
+	                		fprintf(rejects, "%lu: %*.*s insoluble\n", number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+                                        break;
+                                default:
+                                	bogus++;
+	                		fprintf(rejects, "%lu: %s invalid puzzle format\n", number, inbuf);
+                                        break;
+                        }
+                        *inbuf = 0;
+                        continue;
+                }
+
+                /* Count only, with a transposition table */
+                if (counter) {
+                	if (!solver_load(counter, inbuf)) {
+	                	fprintf(rejects, "%lu: %s invalid puzzle format\n", number, inbuf);
+                                bogus += 1;
+                        }
+                        else {
+	                        solncount = solver_count(counter);
+	                        solver_stats(counter, &stats);
+
+	                        usecs = clock_usecs() - start;
+	                        hist_record(&hist, usecs);
+	                        if (capture && (usecs >= slow_usecs || stats.nodes >= slow_nodes))
+	                        	capture_puzzle(capture, inbuf, usecs, &stats);
+
+	                        if (stats.status == SOLVE_TIMEOUT || stats.status == SOLVE_CANCELLED) {
+	                        	timedout++;
+	                		fprintf(rejects, "%lu: %*.*s timed out after %lu nodes, %lu msecs\n",
+	                        		number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf, stats.nodes, stats.msecs);
+	                        }
+	                        else if (solncount) solved++;
+	                        else unsolved++;
+	                        if (solncount != 1) rc |= 1;
+	                        if (prt_num) fprintf(solnfile, "%lu: ", number);
+	                        fprintf(solnfile, "count: %d\n", solncount);
+                        }
+                        *inbuf = 0;
+                        continue;
+                }
+
+                /* A puzzle seen before need not be solved again */
+                if (store && strlen(inbuf) >= PUZZLE_CELLS && store_lookup(store, inbuf, store_mode, &entry)) {
+                	solved_list = stored_soln(&entry, inbuf);
+                        memset(&stats, 0, sizeof(stats));
+                }
+                else {
+	                if (prt_rating)
+	                	solved_list = rate_sudoku(inbuf);
+#ifdef THREADS
+	                else if (threads > 1)
+	                	solved_list = solve_portfolio(inbuf, threads);
+#endif
+	                else
+	                	solved_list = solve_sudoku(inbuf);
+	                solve_stats(&stats);
+
+                        /* Keep unique (or first) solutions for next time */
+                        if (store && solved_list && solved_list->grid.solncount && solved_list->next == NULL &&
+                            stats.status == SOLVE_OK && !stats.refuted) {
+                        	format_answer(&solved_list->grid, entry.answer);
+                                entry.solncount = solved_list->grid.solncount;
+                                entry.score = solved_list->grid.score;
+                                entry.maxlvl = solved_list->grid.maxlvl;
+                                entry.rating = solved_list->grid.rating;
+                                store_insert(store, inbuf, store_mode, &entry);
+                        }
+                }
 
-                if ((solved_list = solve_sudoku(inbuf)) == NULL) {
-                	fprintf(rejects, "%d: %s invalid puzzle format\n", count, inbuf);
+                /* Time the puzzle, and keep it if it was slow */
+                usecs = clock_usecs() - start;
+                hist_record(&hist, usecs);
+                if (capture && (usecs >= slow_usecs || stats.nodes >= slow_nodes))
+                	capture_puzzle(capture, inbuf, usecs, &stats);
+
+                if (solved_list == NULL) {
+                	if (stats.status == SOLVE_FEWGIVENS)
+	                	fprintf(rejects, "%lu: %s too few givens\n", number, inbuf);
+                        else
+	                	fprintf(rejects, "%lu: %s invalid puzzle format\n", number, inbuf);
 	                *inbuf = 0;
                         bogus += 1;
                         continue;
                 }
 
-        	if (solved_list->solncount) {
+                if (stats.refuted) {
+                	fprintf(rejects, "%lu: %*.*s is not unique, uniqueness deductions discarded\n",
+                        	number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+                }
+
+                /* Filter on difficulty, printing the puzzles in the band rather than their solutions */
+                if (band) {
+                	g = &solved_list->grid;
+	                if (stats.status == SOLVE_TIMEOUT || stats.status == SOLVE_CANCELLED) {
+	                	timedout++;
+	                        rc |= 1;
+	                	fprintf(rejects, "%lu: %*.*s timed out after %lu nodes, %lu msecs\n",
+	                        	number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf, stats.nodes, stats.msecs);
+	                }
+                        else if (g->solncount) {
+                        	solved++;
+                                if (solved_list->next) rc |= 1;
+                                else if (g->score >= min_score && (!limits.max_score || g->score <= limits.max_score) &&
+                                         g->maxlvl >= min_depth && (!limits.max_depth || g->maxlvl <= limits.max_depth)) {
+                                	matched++;
+                                	if (prt_num) fprintf(solnfile, "%lu: ", number);
+                                        fprintf(solnfile, "%s", inbuf);
+	        	                if (prt_score) fprintf(solnfile, " score: %d", g->score);
+	                	        if (prt_depth) fprintf(solnfile, " depth: %d", g->maxlvl);
+                                        fprintf(solnfile, "\n");
+                                }
+                        }
+                        else if (stats.status != SOLVE_TOOHARD) {	/* too hard is merely out of the band */
+	                	unsolved++;
+	                        rc |= 1;
+	                	fprintf(rejects, "%lu: %*.*s insoluble\n", number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+                        }
+	                free_soln_list(solved_list);
+                        *inbuf = 0;
+                        continue;
+                }
+
+                if (stats.status == SOLVE_TIMEOUT || stats.status == SOLVE_CANCELLED) {
+                	timedout++;
+                        rc |= 1;
+                	fprintf(rejects, "%lu: %*.*s timed out after %lu nodes, %lu msecs\n",
+                        	number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf, stats.nodes, stats.msecs);
+                }
+
+        	if (solved_list->grid.solncount) {
 	               	solved++;
-	                for (solncount = 0, g = s = solved_list; s; s = s->next) {
+	                for (solncount = 0, g = &(s = solved_list)->grid; s; s = s->next) {
                         	solncount += 1;
 	        		if (prt_num) {
-        	                	char nbuf[32];
+        	                	char nbuf[48];
                 	                if (first_soln_only)
-						sprintf(nbuf, "%d: ", count);
+						sprintf(nbuf, "%lu: ", number);
                                         else
-						sprintf(nbuf, "%d:%d ", count, solncount);
+						sprintf(nbuf, "%lu:%d ", number, solncount);
 					fprintf(solnfile, "%-s", nbuf);
 	                        }
                                 if (solncount > 1 || first_soln_only) g->score = 0;
         	                if (prt_score) fprintf(solnfile, "score: %-7d ", g->score);
                 	        if (prt_depth) fprintf(solnfile, "depth: %-3d ", g->maxlvl);
-                        	if (prt_answer || prt_grid) format_answer(s, outbuf);
+                	        if (prt_rating) fprintf(solnfile, "rating: %d %-8s", s->grid.rating, rating_name(s->grid.rating));
+                        	if (prt_answer || prt_grid) format_answer(&s->grid, outbuf);
 	                        if (prt_answer) fprintf(solnfile, "%s", outbuf);
                                 if (prt_mask) fprintf(solnfile, " %s", cvt_to_mask(mbuf, inbuf));
                                 if (prt_givens) fprintf(solnfile, " %d", g->givens);
@@ -268,11 +1005,12 @@ int main(int argc, char **argv)
                                	rc |= 1;
                         }
                 }
-                else {
+                else if (stats.status != SOLVE_TIMEOUT && stats.status != SOLVE_CANCELLED) {
                 	unsolved++;
                         rc |= 1;
-                	fprintf(rejects, "%d: %*.*s insoluble\n", count, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
-			diagnostic_grid(solved_list, rejects);
+                        solve_diagnose(rejects);
+                	fprintf(rejects, "%lu: %*.*s insoluble\n", number, PUZZLE_CELLS, PUZZLE_CELLS, inbuf);
+			diagnostic_grid(&solved_list->grid, rejects);
                         #if defined(DEBUG)
 			mypause();
                         #endif
@@ -283,8 +1021,20 @@ int main(int argc, char **argv)
                 *inbuf = 0;
 	}
 
-        if (prt)
+        if (prt && (limits.max_nodes || limits.max_msecs))
+		fprintf(solnfile, "\nPuzzles: %d, Solved: %d, Insoluble: %d, Invalid: %d, Timed out: %d\n", count, solved, unsolved, bogus, timedout);
+        else if (prt)
 		fprintf(solnfile, "\nPuzzles: %d, Solved: %d, Insoluble: %d, Invalid: %d\n", count, solved, unsolved, bogus);
 
+        if (prt && band) fprintf(solnfile, "In band: %d\n", matched);
+
+        if (prt_latency) hist_print(&hist, solnfile);
+
+        if (capture) fclose(capture);
+
+        if (store) store_close(store);
+
+        if (sel.ix) index_close(sel.ix);
+
 	return rc;
 }
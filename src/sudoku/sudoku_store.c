@@ -0,0 +1,356 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_store.c                                                             */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* A persistent, memory mapped store of solved puzzles. See sudoku_store.h for the  */
+/* interface and the layout of the file.                                            */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sudoku_store.h"
+
+#ifdef MMAP_STORE
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#define STORE_MAGIC   "SUDSTOR1"
+#define STORE_BUCKETS (1 << 16)	/* hash buckets in a new store            */
+#define STORE_GROW    4096		/* records added each time the file grows */
+#define STORE_ALIGN   4096		/* records start on a page boundary       */
+
+/* Publication of records to lock-free readers */
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(p)     (*(volatile uint32_t *) (p))
+#define STORE_RELEASE(p, v) (*(volatile uint32_t *) (p) = (v))
+#endif
+
+/* The head of the file, followed by the bucket table */
+typedef struct store_hdr {
+	char magic[8];
+        uint32_t buckets;		/* number of buckets, a power of two      */
+        uint32_t recsize;		/* size of a record                       */
+        uint32_t count;			/* records appended so far                */
+        uint32_t reserved;
+} StoreHdr;
+
+/* A solved puzzle. Puzzles and answers hold a digit per nibble, zero if unsolved. */
+typedef struct store_rec {
+	uint64_t key;			/* hash of the puzzle and mode            */
+        uint32_t next;			/* next record in the bucket plus one, or 0 */
+        uint32_t mode;
+        uint32_t solncount, score;
+        uint8_t maxlvl, rating;
+        uint8_t puzzle[(PUZZLE_CELLS+1)/2];
+        uint8_t answer[(PUZZLE_CELLS+1)/2];
+        uint32_t check;			/* checksum of the above, written last    */
+} StoreRec;
+
+struct sudoku_store {
+	int fd, writable;
+        char *base;			/* the mapping of the file                */
+        size_t size;			/* and its length                         */
+        size_t data;			/* offset of the first record             */
+        StoreHdr *hdr;
+        uint32_t *bucket;
+        StoreRec *rec;
+};
+
+/* Offset of the first record in a store with the given number of buckets */
+static size_t data_offset(uint32_t buckets)
+{
+	size_t n = sizeof(StoreHdr) + buckets * sizeof(uint32_t);
+
+        return (n + STORE_ALIGN - 1) / STORE_ALIGN * STORE_ALIGN;
+}
+
+/* Pack a puzzle string, a digit per nibble. Returns zero if it is too short. */
+static int pack(uint8_t *out, const char *s)
+{
+	int i, d;
+
+        memset(out, 0, (PUZZLE_CELLS+1)/2);
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	if (s[i] == 0) return 0;
+        	d = (s[i] >= '1' && s[i] <= '9') ? s[i] - '0' : 0;
+                out[i/2] |= d << (4 * (i & 1));
+        }
+
+        return 1;
+}
+
+static void unpack(char *out, const uint8_t *in)
+{
+	int i, d;
+
+        for (i = 0; i < PUZZLE_CELLS; i++) {
+        	d = (in[i/2] >> (4 * (i & 1))) & 15;
+                out[i] = d ? '0' + d : '.';
+        }
+        out[i] = 0;
+}
+
+/* FNV-1a hashes, for the key and the checksum */
+static uint64_t hash64(const void *p, size_t n, uint64_t h)
+{
+	const uint8_t *s = p;
+
+        while (n--) h = (h ^ *s++) * 0x100000001b3ull;
+        return h;
+}
+
+static uint64_t record_key(const uint8_t *packed, uint32_t mode)
+{
+	uint64_t h = hash64(packed, (PUZZLE_CELLS+1)/2, 0xcbf29ce484222325ull);
+
+        return hash64(&mode, sizeof(mode), h);
+}
+
+static uint32_t record_check(const StoreRec *r)
+{
+	uint64_t h = hash64(r, offsetof(StoreRec, check), 0xcbf29ce484222325ull);
+
+        return (uint32_t) (h ^ (h >> 32));
+}
+
+/*****************************************************************/
+/* Map the whole file, again if it has grown since it was last   */
+/* mapped. Returns zero on failure, leaving the old mapping.     */
+/*****************************************************************/
+
+static int map_store(SUDOKU_STORE *st)
+{
+	struct stat sb;
+        char *base;
+
+        if (fstat(st->fd, &sb) != 0) return 0;
+        if ((size_t) sb.st_size < sizeof(StoreHdr)) {
+        	errno = EINVAL;
+                return 0;
+        }
+        if ((size_t) sb.st_size == st->size) return 1;
+
+        base = mmap(NULL, sb.st_size, st->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, st->fd, 0);
+        if (base == MAP_FAILED) return 0;
+
+        if (st->base) munmap(st->base, st->size);
+
+        st->base = base;
+        st->size = sb.st_size;
+        st->hdr = (StoreHdr *) base;
+        st->bucket = (uint32_t *) (base + sizeof(StoreHdr));
+        st->data = data_offset(st->hdr->buckets);
+        st->rec = (StoreRec *) (base + st->data);
+
+        return 1;
+}
+
+/* Set up a new (or never completed) store */
+static int init_store(SUDOKU_STORE *st)
+{
+	StoreHdr h;
+
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+        h.buckets = STORE_BUCKETS;
+        h.recsize = sizeof(StoreRec);
+
+        /* Zero the buckets and make room before the header makes the file a store */
+        if (ftruncate(st->fd, 0) != 0) return 0;
+        if (ftruncate(st->fd, data_offset(h.buckets) + STORE_GROW * sizeof(StoreRec)) != 0) return 0;
+        if (pwrite(st->fd, &h, sizeof(h), 0) != sizeof(h)) return 0;
+
+        return 1;
+}
+
+SUDOKU_STORE *store_open(const char *path, int writable)
+{
+	SUDOKU_STORE *st;
+        StoreHdr h;
+        ssize_t n;
+        int ok = 1;
+
+	if ((st = calloc(1, sizeof(SUDOKU_STORE))) == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+        st->writable = writable;
+
+        if ((st->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666)) < 0) {
+        	free(st);
+                return NULL;
+        }
+
+        /* A writer sets the store up if no one has yet */
+        if (writable) {
+        	flock(st->fd, LOCK_EX);
+                /* An empty file, or one whose set up was cut short. Anything else is not ours. */
+                n = pread(st->fd, &h, sizeof(h), 0);
+                if (n == 0 || (n == sizeof(h) && h.magic[0] == 0)) ok = init_store(st);
+                flock(st->fd, LOCK_UN);
+        }
+
+        if (ok && (ok = map_store(st)) != 0) {
+        	if (memcmp(st->hdr->magic, STORE_MAGIC, sizeof(st->hdr->magic)) != 0 ||
+                    st->hdr->recsize != sizeof(StoreRec) || !st->hdr->buckets ||
+                    (st->hdr->buckets & (st->hdr->buckets - 1)) || st->data > st->size) {
+                	errno = EINVAL;
+                        ok = 0;
+                }
+        }
+
+        if (!ok) {
+        	store_close(st);
+                return NULL;
+        }
+
+        return st;
+}
+
+int store_lookup(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, STORE_ENTRY *e)
+{
+	uint8_t p[(PUZZLE_CELLS+1)/2];
+        const StoreRec *r;
+        uint64_t key;
+        uint32_t i;
+
+        if (!pack(p, puzzle)) return 0;
+        key = record_key(p, mode);
+
+        for (i = LOAD_ACQUIRE(&st->bucket[key & (st->hdr->buckets - 1)]); i; i = r->next) {
+
+        	/* Another process may have grown the file since we mapped it */
+        	if (st->data + (size_t) i * sizeof(StoreRec) > st->size) {
+                	if (!map_store(st) || st->data + (size_t) i * sizeof(StoreRec) > st->size) return 0;
+                }
+
+                r = &st->rec[i-1];
+                if (r->key != key || r->mode != mode || memcmp(r->puzzle, p, sizeof(p)) != 0) continue;
+                if (r->check != record_check(r)) return 0;
+
+                unpack(e->answer, r->answer);
+                e->solncount = r->solncount;
+                e->score = r->score;
+                e->maxlvl = r->maxlvl;
+                e->rating = r->rating;
+                return 1;
+        }
+
+        return 0;
+}
+
+/*****************************************************************/
+/* Append a record, with the file locked. The record is written  */
+/* in full and counted before it is linked into its bucket, so   */
+/* readers never see it half done, and a writer that dies before */
+/* linking it leaves only an unreachable record behind. Chains   */
+/* only ever point to older records, so they cannot loop.        */
+/*****************************************************************/
+
+static int append_record(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, const STORE_ENTRY *e)
+{
+        StoreRec *r;
+        uint32_t n, *b;
+
+        /* Make room for the record, unless another writer already has */
+        n = st->hdr->count;
+        if (st->data + (size_t) (n + 1) * sizeof(StoreRec) > st->size) {
+        	if (!map_store(st)) return 0;
+        	if (st->data + (size_t) (n + 1) * sizeof(StoreRec) > st->size) {
+	                if (ftruncate(st->fd, st->data + (size_t) (n + STORE_GROW) * sizeof(StoreRec)) != 0) return 0;
+	                if (!map_store(st)) return 0;
+                }
+        }
+
+        r = &st->rec[n];
+        memset(r, 0, sizeof(StoreRec));
+        if (!pack(r->puzzle, puzzle) || !pack(r->answer, e->answer)) {
+        	errno = EINVAL;
+                return 0;
+        }
+        r->key = record_key(r->puzzle, mode);
+        r->mode = mode;
+        r->solncount = e->solncount;
+        r->score = e->score;
+        r->maxlvl = e->maxlvl;
+        r->rating = e->rating;
+
+        b = &st->bucket[r->key & (st->hdr->buckets - 1)];
+        r->next = *b;
+        r->check = record_check(r);
+
+        STORE_RELEASE(&st->hdr->count, n + 1);
+        STORE_RELEASE(b, n + 1);
+
+        return 1;
+}
+
+int store_insert(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, const STORE_ENTRY *e)
+{
+	STORE_ENTRY old;
+        int rc;
+
+        if (!st->writable) {
+        	errno = EBADF;
+                return 0;
+        }
+
+        flock(st->fd, LOCK_EX);
+        rc = store_lookup(st, puzzle, mode, &old) || append_record(st, puzzle, mode, e);
+        flock(st->fd, LOCK_UN);
+
+        return rc;
+}
+
+void store_close(SUDOKU_STORE *st)
+{
+	if (st->base) munmap(st->base, st->size);
+        close(st->fd);
+        free(st);
+}
+
+#else
+
+SUDOKU_STORE *store_open(const char *path, int writable)
+{
+	errno = ENOSYS;
+        return NULL;
+}
+
+int store_lookup(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, STORE_ENTRY *e)
+{
+	return 0;
+}
+
+int store_insert(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, const STORE_ENTRY *e)
+{
+	return 0;
+}
+
+void store_close(SUDOKU_STORE *st)
+{
+}
+
+#endif
@@ -0,0 +1,85 @@
+/************************************************************************************/
+/*                                                                                  */
+/* Name: sudoku_store.h                                                             */
+/* Language: C                                                                      */
+/*                                                                                  */
+/* A persistent store of solved puzzles, kept in a memory mapped file so that it    */
+/* may be shared by any number of solver processes and survives restarts.           */
+/*                                                                                  */
+/* The file holds a fixed table of hash buckets followed by an append-only array    */
+/* of fixed size records. Each record holds a puzzle, the settings it was solved    */
+/* under, its (first) solution, solution count, score, depth and rating. Readers    */
+/* take no locks: a record is published by storing its index in its bucket only     */
+/* after it has been written in full, and records are never changed afterwards.     */
+/* Writers append under an exclusive lock on the file. The file only ever grows,    */
+/* and a writer that dies part way through leaves at worst an unreachable record.   */
+/*                                                                                  */
+/* The store needs mmap() and flock(), so it is only built when MMAP_STORE is       */
+/* defined. Otherwise store_open() always fails (with errno set to ENOSYS.)         */
+/*                                                                                  */
+/* LICENSE:                                                                         */
+/*                                                                                  */
+/* This program is free software; you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by             */
+/* the Free Software Foundation; either version 2 of the License, or                */
+/* (at your option) any later version.                                              */
+/*                                                                                  */
+/************************************************************************************/
+
+#ifndef _SUDSTORE_H_
+
+#define _SUDSTORE_H_
+
+#include "sudoku_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************/
+/* Opaque handle on an open store. A handle may only be used by  */
+/* one thread at a time; other threads and processes should open */
+/* handles of their own.                                         */
+/*****************************************************************/
+
+typedef struct sudoku_store SUDOKU_STORE;
+
+/* What the store knows of a solved puzzle */
+typedef struct store_entry {
+	char answer[PUZZLE_CELLS+1];		/* first solution, as from format_answer() */
+        unsigned int solncount, score;
+        int maxlvl, rating;
+} STORE_ENTRY;
+
+/*****************************************************************/
+/* store_open() opens the store in the named file, creating it   */
+/* if need be when writable is non-zero. It returns NULL, with   */
+/* errno set, if the file cannot be opened or is not a store.    */
+/*                                                               */
+/* store_lookup() looks a puzzle up, and returns non-zero and    */
+/* fills in the entry if it is found. The mode is an arbitrary   */
+/* tag for the settings the puzzle is solved under (first        */
+/* solution only, rating, etc.), as results differ between them; */
+/* a puzzle is only found under the mode it was stored with.     */
+/* Only the first 81 characters of the puzzle are read, and any  */
+/* character but a digit 1-9 is taken as an unsolved cell. A     */
+/* puzzle shorter than that is never found.                      */
+/*                                                               */
+/* store_insert() appends a puzzle to a store opened writable.   */
+/* It returns zero if the store could not be grown, or if the    */
+/* puzzle or its answer is too short. A puzzle already present   */
+/* is left as it is.                                             */
+/*                                                               */
+/* store_close() releases the handle.                            */
+/*****************************************************************/
+
+SUDOKU_STORE *store_open(const char *path, int writable);
+int store_lookup(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, STORE_ENTRY *e);
+int store_insert(SUDOKU_STORE *st, const char *puzzle, unsigned int mode, const STORE_ENTRY *e);
+void store_close(SUDOKU_STORE *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif